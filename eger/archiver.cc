@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <iostream>
+#include <algorithm>
+#include "archiver.h"
+
+extern char **environ;
+
+namespace eger {
+
+namespace {
+
+bool exists(const string &fn) {
+    return access(fn.c_str(), F_OK) == 0 || access((fn + ".gz").c_str(), F_OK) == 0;
+}
+
+// archive name without compression suffix, orders archives by age
+string archive_key(const string &name) {
+    if(name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0)
+        return name.substr(0, name.size() - 3);
+    return name;
+}
+
+// "<base>.YYYYMMDD-HHMMSS" optionally followed by "-NNNN" and ".gz"
+bool is_archive_of(const string &name, const string &base) {
+    if(name.size() < base.size() + 16 || name.compare(0, base.size(), base) != 0) return false;
+    const char *p = name.c_str() + base.size();
+    if(*p++ != '.') return false;
+    for(int i = 0; i < 15; ++i, ++p)
+        if(i == 8 ? *p != '-' : (*p < '0' || *p > '9')) return false;
+    return true;
+}
+
+void warn(const string &what, const string &fn) {
+    char str_buf[256];
+    std::cerr << "eger: can't " << what << " \"" << fn << "\": " << strerror_r(errno, str_buf, 256) << "\n";
+}
+
+}
+
+archiver::archiver(bool _compress, size_t _maximum_archives, size_t _maximum_archives_size) :
+    compress(_compress),
+    maximum_archives(_maximum_archives),
+    maximum_archives_size(_maximum_archives_size),
+    last_index(0),
+    finish(false),
+    thread(0)
+{}
+
+archiver::~archiver() {
+    if(!thread) return;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        finish = true;
+    }
+    cond.notify_one();
+    thread->join();
+    delete thread;
+}
+
+bool archiver::rotate(const string &fn) {
+    time_t now = time(0);
+    struct tm now_tm;
+    localtime_r(&now, &now_tm);
+    char stamp[32];
+    strftime(stamp, sizeof(stamp), ".%Y%m%d-%H%M%S", &now_tm);
+    // more than one rotation a second gets numbered, numbers only grow
+    // so that archives removed by retention are never reused
+    if(last_stamp != stamp) {
+        last_stamp = stamp;
+        last_index = 0;
+    }
+    string to = fn + stamp;
+    if(last_index || exists(to))
+        do {
+            snprintf(stamp + 16, sizeof(stamp) - 16, "-%04d", ++last_index);
+            to = fn + stamp;
+        } while(exists(to));
+    if(rename(fn.c_str(), to.c_str()) < 0) {
+        warn("rename", fn);
+        return false;
+    }
+    if(!has_work()) return true;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        pending.push_back(std::make_pair(fn, to));
+        if(!thread) thread = new std::thread(&archiver::run, this);
+    }
+    cond.notify_one();
+    return true;
+}
+
+void archiver::run() {
+#ifdef __linux__
+    // nice value is per thread on linux and is inherited by gzip
+    setpriority(PRIO_PROCESS, syscall(SYS_gettid), 19);
+#endif
+    std::unique_lock<std::mutex> guard(lock);
+    while(true) {
+        while(!finish && pending.empty()) cond.wait(guard);
+        if(pending.empty()) break;
+        std::pair<string, string> job = pending.front();
+        pending.pop_front();
+        guard.unlock();
+        if(compress) gzip(job.second);
+        if(maximum_archives || maximum_archives_size) retain(job.first);
+        guard.lock();
+    }
+}
+
+void archiver::gzip(const string &fn) {
+    if(access(fn.c_str(), F_OK) < 0) return; // already removed by retention
+    const char *argv[] = { "gzip", "-f", "-q", fn.c_str(), 0 };
+    pid_t pid;
+    int err = posix_spawnp(&pid, "gzip", 0, 0, (char* const*) argv, environ);
+    if(err) {
+        errno = err;
+        warn("run gzip for", fn);
+        return;
+    }
+    int status;
+    while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+}
+
+void archiver::retain(const string &fn) {
+    string::size_type slash = fn.rfind('/');
+    string dir = slash == string::npos ? "." : fn.substr(0, slash + 1);
+    string base = slash == string::npos ? fn : fn.substr(slash + 1);
+    DIR *d = opendir(dir.c_str());
+    if(!d) {
+        warn("list", dir);
+        return;
+    }
+    struct archive {
+        string key;
+        string path;
+        size_t size;
+        bool operator<(const archive &a) const { return key < a.key; }
+    };
+    std::vector<archive> archives;
+    size_t total = 0;
+    while(struct dirent *e = readdir(d)) {
+        string name = e->d_name;
+        if(!is_archive_of(name, base)) continue;
+        archive a;
+        a.key = archive_key(name);
+        a.path = slash == string::npos ? name : dir + name;
+        struct stat st;
+        a.size = stat(a.path.c_str(), &st) == 0 ? st.st_size : 0;
+        total += a.size;
+        archives.push_back(a);
+    }
+    closedir(d);
+    std::sort(archives.begin(), archives.end());
+    size_t count = archives.size();
+    for(size_t i = 0; i < archives.size(); ++i) {
+        if((!maximum_archives || count <= maximum_archives) &&
+                (!maximum_archives_size || total <= maximum_archives_size))
+            break;
+        if(unlink(archives[i].path.c_str()) < 0) warn("remove", archives[i].path);
+        --count;
+        total -= archives[i].size;
+    }
+}
+
+}
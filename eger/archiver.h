@@ -0,0 +1,45 @@
+#ifndef EGER_ARCHIVER_H
+#define EGER_ARCHIVER_H
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <eger/types.h>
+
+namespace eger {
+
+// background work on rotated logs: compression and retention,
+// runs on its own low priority thread so writer only renames
+class archiver {
+    public:
+    archiver(bool _compress, size_t _maximum_archives, size_t _maximum_archives_size);
+    ~archiver(); // finishes queued work
+
+    // renames fn to a timestamped archive name next to it and queues the rest
+    bool rotate(const string &fn);
+
+    bool has_work() const { return compress || maximum_archives || maximum_archives_size; }
+
+    private:
+    archiver(const archiver &);
+
+    void run();
+    void gzip(const string &fn);
+    void retain(const string &fn);
+
+    bool compress;
+    size_t maximum_archives;
+    size_t maximum_archives_size;
+    string last_stamp;
+    int last_index;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<std::pair<string, string> > pending; // log name, archive name
+    bool finish;
+    std::thread *thread;
+};
+
+}
+
+#endif
@@ -0,0 +1,144 @@
+#include <unistd.h>
+#include <algorithm>
+#include <mutex>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#endif
+#include "clock.h"
+
+namespace eger {
+
+fast_clock::clock_state fast_clock::state = { {0}, {0}, {0}, {0}, {0}, {0} };
+
+namespace {
+
+#if defined(__x86_64__)
+bool invariant_tsc() {
+    unsigned int a, b, c, d;
+    if(!__get_cpuid(0x80000000, &a, &b, &c, &d) || a < 0x80000007) return false;
+    if(!__get_cpuid(0x80000007, &a, &b, &c, &d)) return false;
+    return d & (1 << 8);
+}
+#endif
+
+}
+
+int64_t fast_clock::slow_now_ns() {
+#if defined(__x86_64__)
+    int usable = state.usable.load(std::memory_order_acquire);
+    if(usable < 0) return realtime_ns();
+    uint32_t seq = state.seq.load(std::memory_order_relaxed);
+    // somebody else is refreshing the anchor
+    if((seq & 1) || !state.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire))
+        return realtime_ns();
+    if(!usable && !invariant_tsc()) {
+        state.usable.store(-1, std::memory_order_release);
+        state.seq.store(seq + 2, std::memory_order_release);
+        return realtime_ns();
+    }
+    uint64_t tsc;
+    int64_t ns;
+    uint64_t mult = state.mult.load(std::memory_order_relaxed);
+    if(!usable) {
+        // first calibration, measure over a millisecond
+        uint64_t tsc0 = __rdtsc();
+        int64_t ns0 = realtime_ns();
+        do {
+            tsc = __rdtsc();
+            ns = realtime_ns();
+        } while(ns - ns0 < 1000000 && ns >= ns0);
+        if(ns <= ns0 || tsc <= tsc0) {
+            state.usable.store(-1, std::memory_order_release);
+            state.seq.store(seq + 2, std::memory_order_release);
+            return ns;
+        }
+        mult = (((unsigned __int128) (ns - ns0)) << 32) / (tsc - tsc0);
+    } else {
+        tsc = __rdtsc();
+        ns = realtime_ns();
+        uint64_t base_tsc = state.base_tsc.load(std::memory_order_relaxed);
+        int64_t base_ns = state.base_ns.load(std::memory_order_relaxed);
+        // refine the factor over the whole last period, ignoring clock steps
+        if(tsc > base_tsc && ns > base_ns) {
+            uint64_t measured = (((unsigned __int128) (ns - base_ns)) << 32) / (tsc - base_tsc);
+            if(measured > mult - mult / 50 && measured < mult + mult / 50)
+                mult = measured;
+        }
+    }
+    state.base_tsc.store(tsc, std::memory_order_relaxed);
+    state.base_ns.store(ns, std::memory_order_relaxed);
+    state.mult.store(mult, std::memory_order_relaxed);
+    // anchor is refreshed after 10ms at first, the period doubles up to a second
+    uint64_t period = state.period.load(std::memory_order_relaxed);
+    uint64_t second = (((uint64_t) 1000000000) << 32) / mult;
+    period = period ? std::min(period * 2, second) : second / 100;
+    state.period.store(period, std::memory_order_relaxed);
+    state.usable.store(1, std::memory_order_release);
+    state.seq.store(seq + 2, std::memory_order_release);
+    return ns;
+#else
+    return realtime_ns();
+#endif
+}
+
+// backend of tick_clock, picked when the library is built:
+//   EGER_TIMER_TSC           invariant TSC, CLOCK_MONOTONIC when it is unusable (x86_64 default)
+//   EGER_TIMER_MONOTONIC     clock_gettime(CLOCK_MONOTONIC) (default elsewhere)
+//   EGER_TIMER_GETTIMEOFDAY  gettimeofday
+#if !defined(EGER_TIMER_TSC) && !defined(EGER_TIMER_MONOTONIC) && !defined(EGER_TIMER_GETTIMEOFDAY)
+#if defined(__x86_64__)
+#define EGER_TIMER_TSC
+#else
+#define EGER_TIMER_MONOTONIC
+#endif
+#endif
+#if defined(EGER_TIMER_TSC) && !defined(__x86_64__)
+#undef EGER_TIMER_TSC
+#define EGER_TIMER_MONOTONIC
+#endif
+
+tick_clock::tick_state tick_clock::state = { {backend_unknown}, {0} };
+
+uint64_t tick_clock::slow_ticks() {
+    if(state.backend.load(std::memory_order_acquire) == backend_unknown) choose_backend();
+    switch(state.backend.load(std::memory_order_relaxed)) {
+#if defined(__x86_64__)
+        case backend_tsc: return __rdtsc();
+#endif
+        case backend_gettimeofday: {
+            struct timeval tv;
+            gettimeofday(&tv, 0);
+            return ((uint64_t) tv.tv_sec) * 1000000000 + tv.tv_usec * 1000;
+        }
+        default: return monotonic_ns();
+    }
+}
+
+// TSC is measured once over 5ms, threads coming meanwhile wait for it
+// so that all ticks of a process are of the same kind
+void tick_clock::choose_backend() {
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard(lock);
+    if(state.backend.load(std::memory_order_acquire) != backend_unknown) return;
+    int b = backend_monotonic;
+#if defined(EGER_TIMER_TSC)
+    if(invariant_tsc()) {
+        uint64_t tsc0 = __rdtsc();
+        uint64_t ns0 = monotonic_ns();
+        uint64_t tsc, ns;
+        do {
+            tsc = __rdtsc();
+            ns = monotonic_ns();
+        } while(ns - ns0 < 5000000);
+        if(tsc > tsc0) {
+            state.mult.store((((unsigned __int128) (ns - ns0)) << 32) / (tsc - tsc0), std::memory_order_relaxed);
+            b = backend_tsc;
+        }
+    }
+#elif defined(EGER_TIMER_GETTIMEOFDAY)
+    b = backend_gettimeofday;
+#endif
+    state.backend.store(b, std::memory_order_release);
+}
+
+}
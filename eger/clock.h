@@ -0,0 +1,114 @@
+#ifndef EGER_CLOCK_H
+#define EGER_CLOCK_H
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+#include <chrono>
+#include <sys/time.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace eger {
+
+// wall clock for record timestamps
+// invariant TSC scaled by a factor calibrated against CLOCK_REALTIME,
+// anchor is refreshed every second by whichever thread notices first,
+// falls back to clock_gettime when TSC is unusable
+class fast_clock {
+    public:
+    static std::chrono::system_clock::time_point now() {
+        return std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(
+                    std::chrono::nanoseconds(now_ns())));
+    }
+
+    static int64_t now_ns() {
+#if defined(__x86_64__)
+        if(state.usable.load(std::memory_order_relaxed) > 0) {
+            uint64_t tsc = __rdtsc();
+            uint32_t seq = state.seq.load(std::memory_order_acquire);
+            uint64_t base_tsc = state.base_tsc.load(std::memory_order_relaxed);
+            int64_t base_ns = state.base_ns.load(std::memory_order_relaxed);
+            uint64_t mult = state.mult.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if(!(seq & 1) && seq == state.seq.load(std::memory_order_relaxed) &&
+                    tsc >= base_tsc && tsc - base_tsc < state.period.load(std::memory_order_relaxed))
+                return base_ns + (int64_t) (((unsigned __int128) (tsc - base_tsc) * mult) >> 32);
+        }
+#endif
+        return slow_now_ns();
+    }
+
+    static int64_t realtime_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return ((int64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    private:
+    static int64_t slow_now_ns();
+
+    struct clock_state {
+        std::atomic<int> usable;            // -1 no, 0 unknown, 1 yes
+        std::atomic<uint32_t> seq;          // odd while anchor is being updated
+        std::atomic<uint64_t> base_tsc;
+        std::atomic<int64_t> base_ns;
+        std::atomic<uint64_t> mult;         // nanoseconds per tick << 32
+        std::atomic<uint64_t> period;       // ticks until anchor refresh
+    };
+    static clock_state state;
+};
+
+// monotonic ticks for measuring intervals, the backend is chosen when the
+// library is built (see clock.cc) and taken from it at run time, so every
+// user of the library counts ticks of the same kind
+class tick_clock {
+    public:
+    enum backend {
+        backend_unknown = 0,                    // till the first ticks()
+        backend_tsc,                            // invariant TSC calibrated against CLOCK_MONOTONIC
+        backend_monotonic,                      // clock_gettime(CLOCK_MONOTONIC)
+        backend_gettimeofday                    // microsecond resolution
+    };
+
+    static uint64_t ticks() {
+        int b = state.backend.load(std::memory_order_relaxed);
+#if defined(__x86_64__)
+        if(__builtin_expect(b == backend_tsc, 1)) return __rdtsc();
+#endif
+        if(b == backend_monotonic) return monotonic_ns();
+        return slow_ticks();
+    }
+
+    static uint64_t to_ns(uint64_t ticks) {
+#if defined(__x86_64__)
+        if(state.backend.load(std::memory_order_relaxed) == backend_tsc)
+            return ((unsigned __int128) ticks * state.mult.load(std::memory_order_relaxed)) >> 32;
+#endif
+        return ticks;
+    }
+
+    static backend current_backend() { return (backend) state.backend.load(std::memory_order_acquire); }
+
+    static uint64_t monotonic_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ((uint64_t) ts.tv_sec) * 1000000000 + ts.tv_nsec;
+    }
+
+    private:
+    static uint64_t slow_ticks();               // chooses backend, gettimeofday
+    static void choose_backend();
+
+    struct tick_state {
+        std::atomic<int> backend;
+        std::atomic<uint64_t> mult;             // nanoseconds per TSC tick << 32
+    };
+    static tick_state state;
+};
+
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include <map>
+#include "writer.h"
+#include "deferred.h"
+
+// turns files written to "binary:" destinations into text
+// usage: eger_decode [-c | -j | -l] file...
+//   -c colored text, -j JSON lines, -l logfmt
+
+namespace {
+
+struct descriptor {
+    std::string format;
+    std::string file;
+    eger::format_descriptor fd;
+};
+
+template <class type> bool get(std::istream &in, type &t) {
+    return (bool) in.read((char*) &t, sizeof(t));
+}
+
+bool get_string(std::istream &in, std::string &s) {
+    uint32_t l;
+    if(!get(in, l)) return false;
+    s.resize(l);
+    return l == 0 || in.read(&s[0], l);
+}
+
+bool decode(const char *file_name, bool ansi_colors, eger::writer::layout format) {
+    std::ifstream in(file_name, std::ios::binary);
+    if(!in) {
+        std::cerr << "can't open " << file_name << "\n";
+        return false;
+    }
+    char magic[sizeof(eger::binary_magic)];
+    if(!in.read(magic, sizeof(magic)) || memcmp(magic, eger::binary_magic, sizeof(magic))) {
+        std::cerr << file_name << " is not an eger binary log\n";
+        return false;
+    }
+    std::map<uint32_t, descriptor> descriptors;
+    std::string payload;
+    char type;
+    while(get(in, type)) {
+        uint32_t id;
+        uint8_t lvl;
+        if(type == 'D') {
+            uint32_t line;
+            if(!get(in, id) || !get(in, lvl) || !get(in, line)) break;
+            descriptor &d = descriptors[id];
+            if(!get_string(in, d.file) || !get_string(in, d.format)) break;
+            d.fd.format = d.format.c_str();
+            d.fd.file = d.file.c_str();
+            d.fd.line = line;
+            d.fd.lvl = (eger::log_level) lvl;
+            continue;
+        }
+        if(type != 'R') {
+            std::cerr << file_name << ": broken record\n";
+            return false;
+        }
+        int64_t ns;
+        uint8_t multiline;
+        if(!get(in, id) || !get(in, lvl) || !get(in, ns) || !get(in, multiline) ||
+                !get_string(in, payload))
+            break;
+        eger::log_stream ls((eger::log_level) lvl);
+        ls.moment = std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::nanoseconds(ns)));
+        ls.multiline = multiline;
+        if(id) {
+            std::map<uint32_t, descriptor>::iterator it = descriptors.find(id);
+            if(it == descriptors.end()) {
+                std::cerr << file_name << ": unknown descriptor " << id << "\n";
+                continue;
+            }
+            ls.format = &it->second.fd;
+        }
+        ls.append(payload.data(), payload.size());
+        if(format == eger::writer::layout_text) std::cout << eger::writer::compose_log_string(&ls, ansi_colors);
+        else {
+            std::string line;
+            eger::writer::compose_structured_string(&ls, format, line);
+            std::cout << line;
+        }
+    }
+    if(!in.eof()) {
+        std::cerr << file_name << ": truncated\n";
+        return false;
+    }
+    return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+    bool ansi_colors = false;
+    eger::writer::layout format = eger::writer::layout_text;
+    bool ok = true;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if(arg == "-c") ansi_colors = true;
+        else if(arg == "-j") format = eger::writer::layout_json;
+        else if(arg == "-l") format = eger::writer::layout_logfmt;
+        else ok = decode(argv[i], ansi_colors, format) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <inttypes.h>
+#include "deferred.h"
+
+namespace eger {
+
+const char binary_magic[8] = { 'E', 'G', 'E', 'R', 'B', 'I', 'N', '1' };
+
+bool deferred_reader::next(deferred_value &v) {
+    v.key = 0;
+    v.key_len = 0;
+    if(!next_value(v)) return false;
+    if(v.tag != tag_key && v.tag != tag_key_string) return true;
+    v.key = v.s;
+    v.key_len = v.len;
+    return next_value(v) && v.tag != tag_key && v.tag != tag_key_string;
+}
+
+bool deferred_reader::next_value(deferred_value &v) {
+    char t;
+    if(!get(t)) return false;
+    v.tag = (deferred_tag) t;
+    switch(v.tag) {
+        case tag_signed: return get(v.i);
+        case tag_unsigned: return get(v.u);
+        case tag_double: return get(v.d);
+        case tag_char:
+        case tag_bool:
+            if(!get(t)) return false;
+            v.i = t;
+            return true;
+        case tag_literal:
+        case tag_key:
+            if(!get(v.s)) return false;
+            v.len = strlen(v.s);
+            return true;
+        case tag_string:
+        case tag_key_string: {
+            uint32_t l;
+            if(!get(l) || (size_t) (end - p) < l) return false;
+            v.s = p;
+            v.len = l;
+            p += l;
+            return true;
+        }
+    }
+    return false;
+}
+
+void render_deferred_value(const deferred_value &v, string &out) {
+    char buf[32];
+    int n = 0;
+    switch(v.tag) {
+        case tag_signed: n = snprintf(buf, sizeof(buf), "%" PRId64, v.i); break;
+        case tag_unsigned: n = snprintf(buf, sizeof(buf), "%" PRIu64, v.u); break;
+        case tag_double: n = snprintf(buf, sizeof(buf), "%g", v.d); break;
+        case tag_char: out += (char) v.i; return;
+        case tag_bool: out += v.i ? "1" : "0"; return;
+        case tag_string:
+        case tag_literal:
+        case tag_key:
+        case tag_key_string: out.append(v.s, v.len); return;
+    }
+    out.append(buf, n);
+}
+
+void render_deferred(const log_stream *ls, string &out, bool with_fields) {
+    deferred_reader args(ls->data(), ls->size());
+    deferred_value v;
+    // key/value fields do not take placeholders
+    bool more;
+    while((more = args.next(v)) && v.key);
+    const char *f = ls->format->format;
+    for(; *f; ++f) {
+        if(f[0] == '{' && f[1] == '}' && more) {
+            render_deferred_value(v, out);
+            while((more = args.next(v)) && v.key);
+            ++f;
+            continue;
+        }
+        out += *f;
+    }
+    for(; more; more = args.next(v))
+        if(!v.key) {
+            out += ' ';
+            render_deferred_value(v, out);
+        }
+    if(!with_fields) return;
+    deferred_reader fields(ls->data(), ls->size());
+    while(fields.next(v))
+        if(v.key) {
+            out += ' ';
+            out.append(v.key, v.key_len);
+            out += '=';
+            render_deferred_value(v, out);
+        }
+}
+
+void logfmt_string(const char *s, size_t len, string &out) {
+    bool quote = !len;
+    for(size_t i = 0; i < len && !quote; ++i)
+        quote = (uint8_t) s[i] <= ' ' || s[i] == '=' || s[i] == '"' || s[i] == '\\';
+    if(!quote) {
+        out.append(s, len);
+        return;
+    }
+    out += '"';
+    for(size_t i = 0; i < len; ++i) {
+        char c = s[i];
+        if(c == '"' || c == '\\') (out += '\\') += c;
+        else if(c == '\n') out += "\\n";
+        else if(c == '\r') out += "\\r";
+        else if(c == '\t') out += "\\t";
+        else out += c;
+    }
+    out += '"';
+}
+
+void json_string(const char *s, size_t len, string &out) {
+    out += '"';
+    for(size_t i = 0; i < len; ++i) {
+        char c = s[i];
+        if(c == '"' || c == '\\') (out += '\\') += c;
+        else if(c == '\n') out += "\\n";
+        else if(c == '\r') out += "\\r";
+        else if(c == '\t') out += "\\t";
+        else if((uint8_t) c < ' ') {
+            char buf[8];
+            snprintf(buf, sizeof(buf), "\\u%04x", (unsigned) c);
+            out += buf;
+        } else out += c;
+    }
+    out += '"';
+}
+
+void render_logfmt_fields(const log_stream *ls, string &out) {
+    deferred_reader args(ls->data(), ls->size());
+    deferred_value v;
+    string value;
+    while(args.next(v)) {
+        if(!v.key) continue;
+        out += ' ';
+        out.append(v.key, v.key_len);
+        out += '=';
+        if(v.tag == tag_bool) out += v.i ? "true" : "false";
+        else {
+            value.clear();
+            render_deferred_value(v, value);
+            logfmt_string(value.data(), value.size(), out);
+        }
+    }
+}
+
+void render_json_fields(const log_stream *ls, string &out) {
+    deferred_reader args(ls->data(), ls->size());
+    deferred_value v;
+    string value;
+    while(args.next(v)) {
+        if(!v.key) continue;
+        out += ',';
+        json_string(v.key, v.key_len, out);
+        out += ':';
+        switch(v.tag) {
+            case tag_bool: out += v.i ? "true" : "false"; break;
+            case tag_double:
+                // JSON has no NaN nor infinities
+                if(v.d != v.d || v.d - v.d != 0) {
+                    out += "null";
+                    break;
+                }
+                {
+                    char buf[32];
+                    out.append(buf, snprintf(buf, sizeof(buf), "%.17g", v.d));
+                }
+                break;
+            case tag_signed:
+            case tag_unsigned: render_deferred_value(v, out); break;
+            default:
+                value.clear();
+                render_deferred_value(v, value);
+                json_string(value.data(), value.size(), out);
+        }
+    }
+}
+
+namespace {
+
+template <class type> void put(string &out, type t) {
+    out.append((const char*) &t, sizeof(t));
+}
+
+void put_string(string &out, const char *s) {
+    uint32_t l = s ? strlen(s) : 0;
+    put(out, l);
+    out.append(s, l);
+}
+
+}
+
+void binary_descriptor(string &out, uint32_t id, const format_descriptor *fd) {
+    out += 'D';
+    put(out, id);
+    put(out, (uint8_t) fd->lvl);
+    put(out, (uint32_t) fd->line);
+    put_string(out, fd->file);
+    put_string(out, fd->format);
+}
+
+void binary_record(string &out, uint32_t id, const log_stream *ls) {
+    using namespace std::chrono;
+    out += 'R';
+    put(out, id);
+    put(out, (uint8_t) ls->lvl);
+    put(out, (int64_t) duration_cast<nanoseconds>(ls->moment.time_since_epoch()).count());
+    put(out, (uint8_t) ls->multiline);
+    size_t at = out.size();
+    put(out, (uint32_t) 0);
+    if(!ls->format) out.append(ls->data(), ls->size());
+    else {
+        // literals are pointers valid in this process only, so they go to disk as strings
+        deferred_reader args(ls->data(), ls->size());
+        deferred_value v;
+        while(args.next(v)) {
+            if(v.key) {
+                out += (char) tag_key_string;
+                put(out, (uint32_t) v.key_len);
+                out.append(v.key, v.key_len);
+            }
+            if(v.tag == tag_literal) v.tag = tag_string;
+            out += (char) v.tag;
+            switch(v.tag) {
+                case tag_signed: put(out, v.i); break;
+                case tag_unsigned: put(out, v.u); break;
+                case tag_double: put(out, v.d); break;
+                case tag_char:
+                case tag_bool: out += (char) v.i; break;
+                case tag_string:
+                case tag_literal:
+                case tag_key:
+                case tag_key_string:
+                    put(out, (uint32_t) v.len);
+                    out.append(v.s, v.len);
+                    break;
+            }
+        }
+    }
+    uint32_t l = out.size() - at - sizeof(uint32_t);
+    memcpy(&out[at], &l, sizeof(l));
+}
+
+}
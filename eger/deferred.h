@@ -0,0 +1,202 @@
+#ifndef EGER_DEFERRED_H
+#define EGER_DEFERRED_H
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+#include <eger/types.h>
+#include <eger/pool.h>
+
+namespace eger {
+
+// static per call site description of a deferred record
+struct format_descriptor {
+    const char *format;     // "{}" marks argument places
+    const char *file;
+    int line;
+    log_level lvl;
+};
+
+// string which outlives the process' logging, stored as a pointer only
+struct literal {
+    explicit literal(const char *_s) : s(_s) {}
+    const char *s;
+};
+
+enum deferred_tag {
+    tag_signed = 'i',
+    tag_unsigned = 'u',
+    tag_double = 'd',
+    tag_char = 'c',
+    tag_bool = 'b',
+    tag_string = 's',
+    tag_literal = 'p',
+    tag_key = 'k',              // literal key of the next value, pointer only
+    tag_key_string = 'K'        // the same stored as string, in binary logs
+};
+
+struct deferred_value {
+    deferred_tag tag;
+    int64_t i;
+    uint64_t u;
+    double d;
+    const char *s;
+    size_t len;
+    const char *key;            // set for key/value fields
+    size_t key_len;
+};
+
+// typed field of a structured record, key has to be a literal
+template <class type>
+struct kv_field {
+    kv_field(const char *_key, const type &_value) : key(_key), value(_value) {}
+    const char *key;
+    const type &value;
+};
+
+template <class type>
+inline kv_field<type> kv(const char *key, const type &value) { return kv_field<type>(key, value); }
+
+// walks encoded arguments of a deferred record
+class deferred_reader {
+    public:
+    deferred_reader(const char *_p, size_t len) : p(_p), end(_p + len) {}
+    bool next(deferred_value &v);
+
+    private:
+    bool next_value(deferred_value &v);
+    template <class type> bool get(type &t) {
+        if((size_t) (end - p) < sizeof(t)) return false;
+        memcpy(&t, p, sizeof(t));
+        p += sizeof(t);
+        return true;
+    }
+    const char *p;
+    const char *end;
+};
+
+// text of a deferred record with arguments put in place of "{}",
+// extra arguments are appended, key/value fields as " key=value" unless skipped
+void render_deferred(const log_stream *ls, string &out, bool with_fields = true);
+void render_deferred_value(const deferred_value &v, string &out);
+
+// key/value fields of a record as " key=value" pairs or as ",\"key\":value"
+// JSON members, values keep their types in JSON
+void render_logfmt_fields(const log_stream *ls, string &out);
+void render_json_fields(const log_stream *ls, string &out);
+
+// escaped and quoted when needed
+void logfmt_string(const char *s, size_t len, string &out);
+void json_string(const char *s, size_t len, string &out);
+
+// binary log file layout, native byte order:
+//   header     "EGERBIN1"
+//   descriptor 'D' u32 id, u8 level, u32 line, u32 len, file, u32 len, format
+//   record     'R' u32 descriptor id (0 for plain text), u8 level, i64 ns since epoch,
+//              u8 multiline, u32 len, text or encoded arguments, literals and keys
+//              are stored as strings
+extern const char binary_magic[8];
+void binary_descriptor(string &out, uint32_t id, const format_descriptor *fd);
+void binary_record(string &out, uint32_t id, const log_stream *ls);
+
+inline void deferred_tag_put(log_stream &ls, deferred_tag t) {
+    char c = (char) t;
+    ls.append(&c, 1);
+}
+
+inline void deferred_arg(log_stream &ls, bool v) {
+    deferred_tag_put(ls, tag_bool);
+    char c = v;
+    ls.append(&c, 1);
+}
+
+inline void deferred_arg(log_stream &ls, char v) {
+    deferred_tag_put(ls, tag_char);
+    ls.append(&v, 1);
+}
+
+inline void deferred_arg(log_stream &ls, signed char v) { deferred_arg(ls, (char) v); }
+inline void deferred_arg(log_stream &ls, unsigned char v) { deferred_arg(ls, (char) v); }
+
+template <class type>
+inline typename std::enable_if<std::is_integral<type>::value && std::is_signed<type>::value>::type
+deferred_arg(log_stream &ls, type v) {
+    deferred_tag_put(ls, tag_signed);
+    int64_t i = v;
+    ls.append(&i, sizeof(i));
+}
+
+template <class type>
+inline typename std::enable_if<std::is_integral<type>::value && std::is_unsigned<type>::value>::type
+deferred_arg(log_stream &ls, type v) {
+    deferred_tag_put(ls, tag_unsigned);
+    uint64_t u = v;
+    ls.append(&u, sizeof(u));
+}
+
+template <class type>
+inline typename std::enable_if<std::is_floating_point<type>::value>::type
+deferred_arg(log_stream &ls, type v) {
+    deferred_tag_put(ls, tag_double);
+    double d = v;
+    ls.append(&d, sizeof(d));
+}
+
+inline void deferred_string(log_stream &ls, const char *s, size_t len) {
+    deferred_tag_put(ls, tag_string);
+    uint32_t l = len;
+    ls.append(&l, sizeof(l));
+    ls.append(s, len);
+}
+
+inline void deferred_arg(log_stream &ls, const char *v) {
+    if(!v) v = "(null)";
+    deferred_string(ls, v, strlen(v));
+}
+
+inline void deferred_arg(log_stream &ls, const string &v) { deferred_string(ls, v.data(), v.size()); }
+
+inline void deferred_arg(log_stream &ls, literal v) {
+    deferred_tag_put(ls, tag_literal);
+    ls.append(&v.s, sizeof(v.s));
+}
+
+template <class type>
+inline void deferred_arg(log_stream &ls, const kv_field<type> &f) {
+    deferred_tag_put(ls, tag_key);
+    ls.append(&f.key, sizeof(f.key));
+    deferred_arg(ls, f.value);
+}
+
+// anything else is formatted right away with its operator<<
+template <class type>
+inline typename std::enable_if<!std::is_arithmetic<type>::value>::type
+deferred_arg(log_stream &ls, const type &v) {
+    deferred_tag_put(ls, tag_string);
+    uint32_t l = 0;
+    size_t at = ls.size();
+    ls.append(&l, sizeof(l));
+    ls << v;
+    l = ls.size() - at - sizeof(l);
+    memcpy(ls.data() + at, &l, sizeof(l));
+}
+
+inline void deferred_args(log_stream &) {}
+
+template <class first, class ... rest>
+inline void deferred_args(log_stream &ls, const first &f, const rest & ... r) {
+    deferred_arg(ls, f);
+    deferred_args(ls, r...);
+}
+
+template <class ... args>
+inline log_stream *deferred_record(const format_descriptor *fd, const args & ... a) {
+    log_stream *ls = log_stream_pool::acquire(fd->lvl);
+    ls->format = fd;
+    deferred_args(*ls, a...);
+    return ls;
+}
+
+}
+
+#endif
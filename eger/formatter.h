@@ -3,6 +3,7 @@
 
 #include <sstream>
 #include <iomanip>
+#include <stdint.h>
 
 namespace eger {
 
@@ -16,6 +17,17 @@ inline string human_readable_number(double d) {
     return d < 0.1 ? (r.size() > (minus ? 7 : 6) ? r.substr(0, (minus ? 7 : 6)) : r) : r;
 }
 
+// nanoseconds as "850ns", "12.5us", "3.25ms" or "1.5s"
+inline string human_readable_duration(uint64_t ns) {
+    std::ostringstream os;
+    os << std::setprecision(3);
+    if(ns < 1000) os << ns << "ns";
+    else if(ns < 1000000) os << (double) ns / 1000 << "us";
+    else if(ns < 1000000000) os << (double) ns / 1000000 << "ms";
+    else os << (double) ns / 1000000000 << "s";
+    return os.str();
+}
+
 }
 
 #endif
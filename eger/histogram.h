@@ -0,0 +1,81 @@
+#ifndef EGER_HISTOGRAM_H
+#define EGER_HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+namespace eger {
+
+// log-linear histogram of nanoseconds, values below 16 have own buckets,
+// every next power of two is split into 16 buckets, values are reported as
+// middles of their buckets, so error is under 3.125% and the whole range
+// of uint64_t fits in 976 buckets
+class histogram {
+    public:
+    static const size_t sub_bits = 4;
+    static const size_t sub_buckets = 1 << sub_bits;
+    static const size_t size = (65 - sub_bits) * sub_buckets;
+
+    histogram() { clear(); }
+
+    static size_t bucket(uint64_t v) {
+        if(v < sub_buckets) return v;
+        size_t e = 63 - __builtin_clzll(v);
+        return (e - sub_bits + 1) * sub_buckets + ((v >> (e - sub_bits)) & (sub_buckets - 1));
+    }
+
+    static uint64_t lowest(size_t b) {
+        if(b < sub_buckets) return b;
+        return ((uint64_t) (sub_buckets + b % sub_buckets)) << (b / sub_buckets - 1);
+    }
+
+    static uint64_t highest(size_t b) {
+        if(b < sub_buckets) return b;
+        return lowest(b) + (((uint64_t) 1) << (b / sub_buckets - 1)) - 1;
+    }
+
+    void add(size_t b, uint64_t n) {
+        counts[b] += n;
+        samples += n;
+    }
+
+    void clear() {
+        memset(counts, 0, sizeof(counts));
+        samples = 0;
+    }
+
+    uint64_t count() const { return samples; }
+
+    static uint64_t middle(size_t b) { return lowest(b) + (highest(b) - lowest(b)) / 2; }
+
+    uint64_t min() const {
+        for(size_t b = 0; b < size; ++b)
+            if(counts[b]) return middle(b);
+        return 0;
+    }
+
+    uint64_t max() const {
+        for(size_t b = size; b; --b)
+            if(counts[b - 1]) return middle(b - 1);
+        return 0;
+    }
+
+    // bucket holding q-th share of samples, q in [0, 1]
+    uint64_t percentile(double q) const {
+        uint64_t rank = (uint64_t) (q * samples + 0.999999);
+        if(!rank) rank = 1;
+        uint64_t seen = 0;
+        for(size_t b = 0; b < size; ++b) {
+            seen += counts[b];
+            if(seen >= rank) return middle(b);
+        }
+        return max();
+    }
+
+    uint64_t counts[size];
+    uint64_t samples;
+};
+
+}
+
+#endif
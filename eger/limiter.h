@@ -0,0 +1,104 @@
+#ifndef EGER_LIMITER_H
+#define EGER_LIMITER_H
+
+#include <stdint.h>
+#include <atomic>
+#include <ostream>
+#include <eger/clock.h>
+
+namespace eger {
+
+// state of one rate limited call site, kept in a static there,
+// every check is a few relaxed atomic operations
+class call_site_limit {
+    public:
+    call_site_limit() : calls(0), suppressed(0), last(0) {}
+
+    bool every_n(uint64_t n, uint64_t &skipped) {
+        if(calls.fetch_add(1, std::memory_order_relaxed) % (n ? n : 1)) return suppress();
+        return pass(skipped);
+    }
+
+    bool first_n(uint64_t n, uint64_t &skipped) {
+        if(calls.fetch_add(1, std::memory_order_relaxed) >= n) return suppress();
+        return pass(skipped);
+    }
+
+    bool every_ms(uint64_t ms, uint64_t &skipped) {
+        uint64_t now = now_ns();
+        uint64_t l = last.load(std::memory_order_relaxed);
+        if((l && now - l < ms * 1000000) ||
+                !last.compare_exchange_strong(l, now, std::memory_order_relaxed))
+            return suppress();
+        return pass(skipped);
+    }
+
+    // token bucket as generic cell rate algorithm, last is the theoretical
+    // arrival time of the next record, burst records may come at once
+    bool token_bucket(uint64_t per_second, uint64_t burst, uint64_t &skipped) {
+        uint64_t interval = 1000000000 / (per_second ? per_second : 1);
+        uint64_t tolerance = interval * (burst ? burst : 1);
+        uint64_t now = now_ns();
+        uint64_t l = last.load(std::memory_order_relaxed);
+        while(true) {
+            uint64_t next = (l > now ? l : now) + interval;
+            if(next - now > tolerance) return suppress();
+            if(last.compare_exchange_weak(l, next, std::memory_order_relaxed)) break;
+        }
+        return pass(skipped);
+    }
+
+    private:
+    static uint64_t now_ns() { return tick_clock::to_ns(tick_clock::ticks()); }
+
+    bool suppress() {
+        suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    bool pass(uint64_t &skipped) {
+        skipped = suppressed.load(std::memory_order_relaxed) ?
+            suppressed.exchange(0, std::memory_order_relaxed) : 0;
+        return true;
+    }
+
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> suppressed;
+    std::atomic<uint64_t> last;             // nanoseconds
+};
+
+struct suppressed_note {
+    suppressed_note(uint64_t _n) : n(_n) {}
+    uint64_t n;
+};
+
+inline std::ostream &operator<<(std::ostream &s, suppressed_note note) {
+    if(note.n) s << " (suppressed " << note.n << " similar messages)";
+    return s;
+}
+
+// level is a name without prefix, e.g. log_every_n(warning, 1000, "x is " << x),
+// arguments are evaluated for records which pass only
+#define log_limited(level, check, streaming_content) \
+    do { \
+        static eger::call_site_limit eger_limit; \
+        uint64_t eger_skipped; \
+        if(eger::is_using_this_level(eger::level_##level) && eger_limit.check) \
+            log_##level(streaming_content << eger::suppressed_note(eger_skipped)); \
+    } while(0)
+
+#define log_every_n(level, n, streaming_content) \
+    log_limited(level, every_n(n, eger_skipped), streaming_content)
+
+#define log_first_n(level, n, streaming_content) \
+    log_limited(level, first_n(n, eger_skipped), streaming_content)
+
+#define log_every_ms(level, ms, streaming_content) \
+    log_limited(level, every_ms(ms, eger_skipped), streaming_content)
+
+#define log_rate_limited(level, per_second, burst, streaming_content) \
+    log_limited(level, token_bucket(per_second, burst, eger_skipped), streaming_content)
+
+}
+
+#endif
@@ -1,54 +1,208 @@
+#include <pthread.h>
 #include <iostream>
+#include <functional>
 #include "logger.h"
 #include "writer.h"
+#include "tracer.h"
+#include "recorder.h"
 
 namespace eger {
 
 instance *instance::eger_instance_ = 0;
-writer *instance::wrt = 0;
-std::thread *instance::wrt_thread = 0;
+std::vector<writer*> instance::writers;
+std::vector<std::thread*> instance::writer_threads;
+std::atomic<level_route*> instance::level_routes[log_level_size];
+std::vector<level_route*> instance::routes;
+const uint32_t instance::not_started;
+std::atomic<uint32_t> instance::enabled_levels(not_started);
+std::atomic<uint32_t> instance::recorded_levels(0);
 
 instance::instance() :
     maximum_log_size(20*1024*1024),
-    ansi_colors(true)
+    maximum_log_archives(0),
+    maximum_archives_size(0),
+    compress_archives(false),
+    mmap_chunk_size(16*1024*1024),
+    mmap_sync_interval(0),
+    memory_sink_size(1024),
+    ansi_colors(true),
+    per_thread_queues(false),
+    flush_interval(1000),
+    dedup_window(0),
+    profiler_dump_interval(0),
+    stats_interval(0),
+    tracing(false),
+    trace_ring_size(64*1024),
+    high_water_mark(0),
+    queue_size(64*1024),
+    overflow_block_timeout(1000),
+    writer_shards(1),
+    flight_recorder_size(256*1024),
+    flight_recorder_file("flight_recorder.bin"),
+    flight_recorder_signals(false),
+    shards(1),
+    recording(false)
 {
+    set_overflow_policy(overflow_drop_newest);
+    for(size_t i = 0; i < log_level_size; ++i) flight_recorder[i] = false;
     eger_instance_ = this;
-    wrt = 0;
-    wrt_thread = 0;
+    enabled_levels.store(not_started, std::memory_order_relaxed);
+    fast_clock::now(); // calibrate before the first record
     resize(log_level_size);
 }
 
 instance::~instance() {
-    if(wrt) wrt->stop();
-    if(wrt_thread) wrt_thread->join();
-    delete wrt_thread;
-    delete wrt;
-    wrt_thread = 0;
-    wrt = 0;
+    if(!trace_file.empty()) trace_write(trace_file.c_str());
+    for(size_t i = 0; i < writers.size(); ++i) writers[i]->stop();
+    for(size_t i = 0; i < writer_threads.size(); ++i) {
+        writer_threads[i]->join();
+        delete writer_threads[i];
+    }
+    enabled_levels.store(0, std::memory_order_relaxed);
+    recorded_levels.store(0, std::memory_order_relaxed);
+    for(size_t i = 0; i < log_level_size; ++i) level_routes[i].store(0, std::memory_order_relaxed);
+    for(size_t i = 0; i < writers.size(); ++i) delete writers[i];
+    for(size_t i = 0; i < routes.size(); ++i) delete routes[i];
+    writer_threads.clear();
+    writers.clear();
+    routes.clear();
     eger_instance_ = 0;
 }
 
 void instance::start_writer() {
-    // born thread with instance of writer
-    assert(!wrt && !wrt_thread);
-    wrt = new writer(this, 64*1024);
-    wrt_thread = new std::thread(writer::static_run, wrt);
+    // born threads with instances of writer, one per shard
+    assert(writers.empty());
+    shards = std::min(std::max(writer_shards, (size_t) 1), maximum_writer_shards);
+    for(size_t i = 0; i < shards; ++i) {
+        writers.push_back(new writer(this, queue_size, per_thread_queues, i));
+        writer_threads.push_back(new std::thread(writer::static_run, writers[i]));
+        if(i < shard_cpus.size() && shard_cpus[i] >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(shard_cpus[i], &cpus);
+            pthread_setaffinity_np(writer_threads[i]->native_handle(), sizeof(cpus), &cpus);
+        }
+    }
+    start_flight_recorder();
+    route_levels();
+    enabled_levels.store(level_mask(*this), std::memory_order_release);
 }
 
 void instance::start_sync_writer() {
-    assert(!wrt && !wrt_thread);
-    wrt = new writer(this);
+    assert(writers.empty());
+    shards = 1;
+    writers.push_back(new writer(this));
+    start_flight_recorder();
+    route_levels();
+    enabled_levels.store(level_mask(*this), std::memory_order_release);
+}
+
+void instance::start_flight_recorder() {
+    recording = false;
+    for(size_t i = 0; i < log_level_size; ++i) recording = recording || flight_recorder[i];
+    if(recording && flight_recorder_signals) flight_recorder_catch_signals();
+}
+
+size_t instance::shard_of(const string &destination) const {
+    if(shards < 2) return 0;
+    std::map<string, size_t>::const_iterator it = destination_shards.find(destination);
+    if(it != destination_shards.end()) return it->second % shards;
+    return std::hash<string>()(destination) % shards;
+}
+
+// routes are never changed, a level gets another one when its destination
+// does, one route per destination and shard is kept like writer keeps one
+// destination per name, destination takes precedence over the recorder
+void instance::route_levels() {
+    uint32_t recorded = 0;
+    for(size_t i = 0; i < log_level_size; ++i) {
+        const string &d = operator[](i);
+        if(d.empty() && flight_recorder[i]) recorded |= 1 << i;
+        level_route *r = level_routes[i].load(std::memory_order_relaxed);
+        if(d.empty()) r = 0;
+        else if(!r || r->destination != d) r = route_to(d);
+        level_routes[i].store(r, std::memory_order_release);
+    }
+    recorded_levels.store(recorded, std::memory_order_release);
+}
+
+level_route *instance::route_to(const string &destination) {
+    writer *to = writers[shard_of(destination)];
+    for(size_t i = 0; i < routes.size(); ++i)
+        if(routes[i]->to == to && routes[i]->destination == destination) return routes[i];
+    routes.push_back(new level_route(to, destination));
+    return routes.back();
+}
+
+// configuration isn't shared with a writer yet
+bool instance::has_destination(log_level lvl) {
+    return eger_instance_ && (size_t) lvl < eger_instance_->size() && !eger_instance_->operator[]((size_t) lvl).empty();
+}
+
+uint32_t instance::level_mask(const log_map &destinations) const {
+    uint32_t mask = 0;
+    for(size_t i = 0; i < log_level_size; ++i)
+        if((i < destinations.size() && !destinations[i].empty()) || flight_recorder[i]) mask |= 1 << i;
+    return mask;
+}
+
+void instance::reconfigure(const log_map &destinations) {
+    std::lock_guard<std::mutex> guard(reconfigure_lock);
+    log_map::operator=(destinations);
+    resize(log_level_size);
+    if(writers.empty()) return;
+    // routes go first so that a newly enabled level finds its destination,
+    // records queued on a shard a level moved away from are written there to
+    // the old destination and may come after newer ones written by the new shard
+    route_levels();
+    enabled_levels.store(level_mask(*this), std::memory_order_release);
+}
+
+void instance::set_destination(log_level lvl, const string &destination) {
+    log_map destinations;
+    {
+        std::lock_guard<std::mutex> guard(reconfigure_lock);
+        destinations = *this;
+    }
+    destinations[(size_t) lvl] = destination;
+    reconfigure(destinations);
+}
+
+logger_stats instance::stats() const {
+    logger_stats s;
+    s.producers = producer_totals();
+    for(size_t i = 0; i < writers.size(); ++i) s.writers.push_back(writers[i]->stats());
+    return s;
 }
 
 void instance::pass_to_writer(log_stream *ls) {
-    if(!wrt) {
+    level_route *r = level_routes[(size_t) ls->lvl].load(std::memory_order_acquire);
+    if(!r) {
+        if((recorded_levels.load(std::memory_order_acquire) >> (unsigned) ls->lvl) & 1) {
+            flight_record(ls);
+            return;
+        }
+        // levels with destination get here before start
+        if(!(enabled_levels.load(std::memory_order_relaxed) & not_started)) {
+            log_stream_pool::release(ls);
+            return;
+        }
         log_stream els(level_warning);
         els << "eger::writer hasn't been started";
         std::cerr << writer::compose_log_string(&els, ansi_colors);
-        delete ls;
+        log_stream_pool::release(ls);
         return;
     }
-    wrt->push_back(ls);
+    if(recording && ls->lvl == level_critical) {
+        flight_recorder_critical();
+        // shard 0 dumps, a synchronous writer has no thread to do it
+        if(writers[0]->sync_mode) {
+            if(flight_recorder_requested()) flight_recorder_dump();
+        } else
+            writers[0]->wake();
+    }
+    ls->route = r;
+    r->to->push_back(ls);
 }
 
 
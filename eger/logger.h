@@ -2,12 +2,21 @@
 #define EGER_LOGGER_H
 
 #include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <vector>
 #include <eger/types.h>
+#include <eger/pool.h>
+#include <eger/deferred.h>
+#include <eger/stats.h>
 #include <assert.h>
 
 namespace eger {
 
 class writer;
+struct level_route;
 
 class instance : public log_map {
     public:
@@ -22,45 +31,105 @@ class instance : public log_map {
         return *eger_instance_;
     }
 
-    inline bool is_using_this_level(log_level lvl) {
-        return !operator[]((size_t) lvl).empty();
+    // one relaxed load, levels without destination are the likely case,
+    // till a writer is started destinations are looked up in the map
+    static inline bool is_using_this_level(log_level lvl) {
+        uint32_t mask = enabled_levels.load(std::memory_order_relaxed);
+        if(__builtin_expect((mask >> (unsigned) lvl) & 1, 0)) return true;
+        return __builtin_expect(mask & not_started, 0) && has_destination(lvl);
     }
 
+    // destinations are set through operator[] before the writer is started,
+    // afterwards a whole new set is published with reconfigure, records passed
+    // from then on go to the new destinations, queued ones where they were headed
+    void reconfigure(const log_map &destinations);
+    void set_destination(log_level lvl, const string &destination);
+
+    // writer shard of a destination, all levels writing to it share the shard
+    size_t shard_of(const string &destination) const;
+
     inline bool is_critical_level(log_level lvl) {
         return lvl == level_critical;
     }
 
     void pass_to_writer(log_stream *ls);
 
+    // counters of producers and every writer shard, see eger/stats.h
+    logger_stats stats() const;
+
     private:
     instance(const instance &);
     instance(instance &&);
 
     public:
     size_t maximum_log_size;
+    size_t maximum_log_archives;                // rotated files kept per log, 0 for all
+    size_t maximum_archives_size;               // bytes of rotated files kept per log, 0 for any
+    bool compress_archives;                     // gzip rotated files in background
+    size_t mmap_chunk_size;                     // "mmap:" files are extended by this much
+    std::chrono::milliseconds mmap_sync_interval; // msync of "mmap:" files, 0 for on close and rotation only
+    size_t memory_sink_size;                    // records kept by "memory:" destinations
     bool ansi_colors;
+    bool per_thread_queues;
+    std::chrono::milliseconds flush_interval;   // longest time a record waits in queue
+    std::chrono::milliseconds dedup_window;     // repeats of a destination's last record are counted, 0 for off
+    std::chrono::seconds profiler_dump_interval; // writer dumps and resets all profiler labels, 0 for never
+    std::chrono::seconds stats_interval;        // writer puts stats_summary at level_profile, 0 for never
+    bool tracing;                               // span_* macros record events
+    size_t trace_ring_size;                     // events kept per thread
+    string trace_file;                          // trace JSON written here on destruction
+    size_t high_water_mark;                     // queue depth waking writer early, 0 for half of queue
+    size_t queue_size;                          // records, per thread with per_thread_queues
+    overflow_policy overflow[log_level_size];
+    std::chrono::microseconds overflow_block_timeout;
+    size_t writer_shards;                       // writer threads with own queues, up to maximum_writer_shards
+    std::map<string, size_t> destination_shards; // shard of a destination name, hash of it otherwise
+    std::vector<int> shard_cpus;                // CPU shard thread i is pinned to, -1 for none
+    bool flight_recorder[log_level_size];       // levels without destination kept in memory per thread
+    size_t flight_recorder_size;                // bytes of records kept per thread
+    string flight_recorder_file;                // binary log they are dumped to on critical records
+    bool flight_recorder_signals;               // and on fatal signals
+
+    void set_overflow_policy(overflow_policy p) {
+        for(size_t i = 0; i < log_level_size; ++i) overflow[i] = p;
+    }
 
-    private:
+    void set_flight_recorder(log_level lvl, bool on = true) { flight_recorder[(size_t) lvl] = on; }
 
+    private:
+    uint32_t level_mask(const log_map &destinations) const;
+    static bool has_destination(log_level lvl);
+    void route_levels();
+    level_route *route_to(const string &destination);
+    void start_flight_recorder();
+
+    std::mutex reconfigure_lock;
+    size_t shards;                              // writers started
+    bool recording;                             // some level goes to flight recorder
+    static const uint32_t not_started = (uint32_t) 1 << 31; // in enabled_levels before start_writer
+    static std::atomic<uint32_t> enabled_levels;     // bit per level with destination
+    static std::atomic<uint32_t> recorded_levels;    // bit per level going to flight recorder
     static instance *eger_instance_;
-    static writer *wrt;
-    static std::thread *wrt_thread;
+    static std::vector<writer*> writers;
+    static std::vector<std::thread*> writer_threads;
+    static std::atomic<level_route*> level_routes[log_level_size]; // shard and destination of level
+    static std::vector<level_route*> routes;    // every one published, records point to them
 };
 
 template<class lambda>
 void logger(log_level log_lvl, const lambda &func) {
-    if(!instance::get_instance().is_using_this_level(log_lvl))
+    if(!is_compiled_level(log_lvl) || !instance::is_using_this_level(log_lvl))
         return;
     instance::get_instance().pass_to_writer(func());
 }
 
 inline bool is_using_this_level(log_level log_lvl) {
-    return instance::get_instance().is_using_this_level(log_lvl);
+    return is_compiled_level(log_lvl) && instance::is_using_this_level(log_lvl);
 }
 
 #define log_func_header(log_level_m) \
     eger::logger(eger::log_level_m, [&] () -> eger::log_stream* { \
-        eger::log_stream *new_stream = new eger::log_stream(eger::log_level_m); \
+        eger::log_stream *new_stream = eger::log_stream_pool::acquire(eger::log_level_m); \
         *new_stream << 
 
 #define log_func_footer \
@@ -72,29 +141,111 @@ inline bool is_using_this_level(log_level log_lvl) {
 #define to_log_multiline(level, streaming_content) \
     log_func_header(level) streaming_content ; new_stream->multiline = true log_func_footer
 
+// arguments are put in place of "{}" in format, eger::kv("key", value) ones
+// are not, they become typed fields of a structured record
+#define to_log_fmt(level, format, ...) \
+    eger::logger(eger::level, [&] () -> eger::log_stream* { \
+        static const eger::format_descriptor eger_descriptor = { format, __FILE__, __LINE__, eger::level }; \
+        return eger::deferred_record(&eger_descriptor, ##__VA_ARGS__); })
+
+#if EGER_MIN_LEVEL >= EGER_LEVEL_CRITICAL
 #define log_critical(streaming_content) to_log(level_critical, streaming_content)
+#define log_critical_multiline(streaming_content) to_log_multiline(level_critical, streaming_content)
+#define log_critical_fmt(format, ...) to_log_fmt(level_critical, format, ##__VA_ARGS__)
+#define log_critical_kv(message, ...) to_log_fmt(level_critical, message, ##__VA_ARGS__)
+#else
+#define log_critical(streaming_content) ((void) 0)
+#define log_critical_multiline(streaming_content) ((void) 0)
+#define log_critical_fmt(format, ...) ((void) 0)
+#define log_critical_kv(message, ...) ((void) 0)
+#endif
+
+#if EGER_MIN_LEVEL >= EGER_LEVEL_ERROR
 #define log_error(streaming_content) to_log(level_error, streaming_content)
+#define log_error_multiline(streaming_content) to_log_multiline(level_error, streaming_content)
+#define log_error_fmt(format, ...) to_log_fmt(level_error, format, ##__VA_ARGS__)
+#define log_error_kv(message, ...) to_log_fmt(level_error, message, ##__VA_ARGS__)
+#else
+#define log_error(streaming_content) ((void) 0)
+#define log_error_multiline(streaming_content) ((void) 0)
+#define log_error_fmt(format, ...) ((void) 0)
+#define log_error_kv(message, ...) ((void) 0)
+#endif
+
+#if EGER_MIN_LEVEL >= EGER_LEVEL_INFO
 #define log_info(streaming_content) to_log(level_info, streaming_content)
+#define log_info_multiline(streaming_content) to_log_multiline(level_info, streaming_content)
+#define log_info_fmt(format, ...) to_log_fmt(level_info, format, ##__VA_ARGS__)
+#define log_info_kv(message, ...) to_log_fmt(level_info, message, ##__VA_ARGS__)
+#else
+#define log_info(streaming_content) ((void) 0)
+#define log_info_multiline(streaming_content) ((void) 0)
+#define log_info_fmt(format, ...) ((void) 0)
+#define log_info_kv(message, ...) ((void) 0)
+#endif
+
+#if EGER_MIN_LEVEL >= EGER_LEVEL_WARNING
 #define log_warning(streaming_content) to_log(level_warning, streaming_content)
+#define log_warning_multiline(streaming_content) to_log_multiline(level_warning, streaming_content)
+#define log_warning_fmt(format, ...) to_log_fmt(level_warning, format, ##__VA_ARGS__)
+#define log_warning_kv(message, ...) to_log_fmt(level_warning, message, ##__VA_ARGS__)
+#else
+#define log_warning(streaming_content) ((void) 0)
+#define log_warning_multiline(streaming_content) ((void) 0)
+#define log_warning_fmt(format, ...) ((void) 0)
+#define log_warning_kv(message, ...) ((void) 0)
+#endif
+
+#if EGER_MIN_LEVEL >= EGER_LEVEL_PROFILE
 #define log_profile(streaming_content) to_log(level_profile, streaming_content)
 #define log_profile_multiline(streaming_content) to_log_multiline(level_profile, streaming_content)
+#define log_profile_fmt(format, ...) to_log_fmt(level_profile, format, ##__VA_ARGS__)
+#define log_profile_kv(message, ...) to_log_fmt(level_profile, message, ##__VA_ARGS__)
+#else
+#define log_profile(streaming_content) ((void) 0)
+#define log_profile_multiline(streaming_content) ((void) 0)
+#define log_profile_fmt(format, ...) ((void) 0)
+#define log_profile_kv(message, ...) ((void) 0)
+#endif
+
+#if EGER_MIN_LEVEL >= EGER_LEVEL_DEBUG
 #define log_debug(streaming_content) to_log(level_debug, streaming_content)
 #define log_debug_multiline(streaming_content) to_log_multiline(level_debug, streaming_content)
-
-#ifdef NDEBUG
-#define log_debug_hard(streaming_content)
-#define log_debug_hard_multiline(streaming_content)
-
-#define log_debug_mare(streaming_content)
-#define log_debug_mare_multiline(streaming_content)
+#define log_debug_fmt(format, ...) to_log_fmt(level_debug, format, ##__VA_ARGS__)
+#define log_debug_kv(message, ...) to_log_fmt(level_debug, message, ##__VA_ARGS__)
 #else
+#define log_debug(streaming_content) ((void) 0)
+#define log_debug_multiline(streaming_content) ((void) 0)
+#define log_debug_fmt(format, ...) ((void) 0)
+#define log_debug_kv(message, ...) ((void) 0)
+#endif
+
+#if EGER_MIN_LEVEL >= EGER_LEVEL_DEBUG_HARD
 #define log_debug_hard(streaming_content) to_log(level_debug_hard, streaming_content)
 #define log_debug_hard_multiline(streaming_content) to_log_multiline(level_debug_hard, streaming_content)
+#define log_debug_hard_fmt(format, ...) to_log_fmt(level_debug_hard, format, ##__VA_ARGS__)
+#define log_debug_hard_kv(message, ...) to_log_fmt(level_debug_hard, message, ##__VA_ARGS__)
+#else
+#define log_debug_hard(streaming_content) ((void) 0)
+#define log_debug_hard_multiline(streaming_content) ((void) 0)
+#define log_debug_hard_fmt(format, ...) ((void) 0)
+#define log_debug_hard_kv(message, ...) ((void) 0)
+#endif
 
+#if EGER_MIN_LEVEL >= EGER_LEVEL_DEBUG_MARE
 #define log_debug_mare(streaming_content) to_log(level_debug_mare, streaming_content)
 #define log_debug_mare_multiline(streaming_content) to_log_multiline(level_debug_mare, streaming_content)
+#define log_debug_mare_fmt(format, ...) to_log_fmt(level_debug_mare, format, ##__VA_ARGS__)
+#define log_debug_mare_kv(message, ...) to_log_fmt(level_debug_mare, message, ##__VA_ARGS__)
+#else
+#define log_debug_mare(streaming_content) ((void) 0)
+#define log_debug_mare_multiline(streaming_content) ((void) 0)
+#define log_debug_mare_fmt(format, ...) ((void) 0)
+#define log_debug_mare_kv(message, ...) ((void) 0)
 #endif
 
 }
 
+#include <eger/limiter.h>
+
 #endif
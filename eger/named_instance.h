@@ -24,6 +24,10 @@ struct named_instance_storage {
         static type v;
         return v;
     }
+    static type& thread_value() {
+        static thread_local type v;
+        return v;
+    }
 };
 
 #define named_instance(type, name) \
@@ -41,6 +45,22 @@ struct named_instance_storage {
         eger::compile_key(#name,30), eger::compile_key(#name,31) \
     >::value())
 
+// same as named_instance, but one per thread
+#define thread_named_instance(type, name) \
+    (eger::named_instance_storage<type, \
+        eger::compile_key(#name, 0), eger::compile_key(#name, 1), eger::compile_key(#name, 2), \
+        eger::compile_key(#name, 3), eger::compile_key(#name, 4), eger::compile_key(#name, 5), \
+        eger::compile_key(#name, 6), eger::compile_key(#name, 7), eger::compile_key(#name, 8), \
+        eger::compile_key(#name, 9), eger::compile_key(#name,10), eger::compile_key(#name,11), \
+        eger::compile_key(#name,12), eger::compile_key(#name,13), eger::compile_key(#name,14), \
+        eger::compile_key(#name,15), eger::compile_key(#name,16), eger::compile_key(#name,17), \
+        eger::compile_key(#name,18), eger::compile_key(#name,19), eger::compile_key(#name,20), \
+        eger::compile_key(#name,21), eger::compile_key(#name,22), eger::compile_key(#name,23), \
+        eger::compile_key(#name,24), eger::compile_key(#name,25), eger::compile_key(#name,26), \
+        eger::compile_key(#name,27), eger::compile_key(#name,28), eger::compile_key(#name,29), \
+        eger::compile_key(#name,30), eger::compile_key(#name,31) \
+    >::thread_value())
+
 }
 
 #endif
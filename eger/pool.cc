@@ -0,0 +1,73 @@
+#include <mutex>
+#include <vector>
+#include "pool.h"
+
+namespace eger {
+
+namespace {
+
+// pools of finished threads are adopted by new ones,
+// records still in flight find their way back regardless
+std::mutex orphans_lock;
+std::vector<log_stream_pool*> orphans;
+
+}
+
+struct local_pool_holder {
+    local_pool_holder() : pool(0) {}
+    ~local_pool_holder() {
+        if(!pool) return;
+        std::lock_guard<std::mutex> guard(orphans_lock);
+        orphans.push_back(pool);
+    }
+    log_stream_pool *pool;
+};
+
+namespace {
+
+thread_local local_pool_holder local;
+
+}
+
+log_stream_pool *log_stream_pool::local_pool() {
+    if(local.pool) return local.pool;
+    {
+        std::lock_guard<std::mutex> guard(orphans_lock);
+        if(!orphans.empty()) {
+            local.pool = orphans.back();
+            orphans.pop_back();
+        }
+    }
+    if(!local.pool) local.pool = new log_stream_pool();
+    return local.pool;
+}
+
+log_stream *log_stream_pool::acquire(log_level lvl) {
+    log_stream_pool *p = local_pool();
+    if(!p->free) p->free = p->returned.exchange(0, std::memory_order_acquire);
+    if(p->free) {
+        log_stream *ls = p->free;
+        p->free = ls->next;
+        ls->reuse(lvl);
+        return ls;
+    }
+    log_stream *ls = new log_stream(lvl);
+    if(p->owned < maximum_records) {
+        ls->pool = p;
+        ++p->owned;
+    }
+    return ls;
+}
+
+void log_stream_pool::release(log_stream *ls) {
+    log_stream_pool *p = ls->pool;
+    if(!p) {
+        delete ls;
+        return;
+    }
+    ls->next = p->returned.load(std::memory_order_relaxed);
+    while(!p->returned.compare_exchange_weak(ls->next, ls,
+                std::memory_order_release, std::memory_order_relaxed));
+}
+
+}
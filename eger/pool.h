@@ -0,0 +1,33 @@
+#ifndef EGER_POOL_H
+#define EGER_POOL_H
+
+#include <atomic>
+#include <eger/types.h>
+
+namespace eger {
+
+// per thread pool of log records
+// records are taken by the owning thread and given back by the writer thread,
+// so steady state logging doesn't touch the allocator
+class log_stream_pool {
+    public:
+    static log_stream *acquire(log_level lvl);
+    static void release(log_stream *ls);
+
+    static const size_t maximum_records = 4096;
+
+    private:
+    log_stream_pool() : free(0), owned(0), returned(0) {}
+    log_stream_pool(const log_stream_pool &);
+
+    static log_stream_pool *local_pool();
+    friend struct local_pool_holder;
+
+    log_stream *free;                     // owner thread only
+    size_t owned;                         // owner thread only
+    std::atomic<log_stream*> returned;    // pushed by any thread, taken whole by owner
+};
+
+}
+
+#endif
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <iomanip>
+#include <fstream>
+#include <map>
+#include "profiler.h"
+
+namespace eger {
+
+profiler_shard::~profiler_shard() {
+    if(label) label->detach(this);
+}
+
+namespace {
+
+struct registry {
+    std::mutex lock;
+    std::vector<profiler_label*> labels;
+};
+
+registry &labels() {
+    static registry r;
+    return r;
+}
+
+}
+
+void profiler_label::attach(profiler_shard *s, const char *_name) {
+    bool first;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        s->label = this;
+        shards.push_back(s);
+        first = !name;
+        if(first) name = _name;
+    }
+    // registry is never locked while holding a label lock
+    if(!first) return;
+    registry &r = labels();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.labels.push_back(this);
+}
+
+void profiler_label::detach(profiler_shard *s) {
+    std::lock_guard<std::mutex> guard(lock);
+    uint64_t calls = s->calls.load(std::memory_order_relaxed) - s->base_calls;
+    retired.ns += s->total_ns.load(std::memory_order_relaxed) - s->base_ns;
+    retired.calls += calls;
+    if(calls) ++retired.threads;
+    for(size_t b = 0; b < histogram::size; ++b)
+        if(uint64_t n = s->samples[b].load(std::memory_order_relaxed) - s->base_samples[b])
+            retired.samples.add(b, n);
+    shards.erase(std::find(shards.begin(), shards.end(), s));
+}
+
+// moves baselines of every shard up to what is collected,
+// shards themselves are never written by other threads
+void profiler_label::collect(totals &t) {
+    std::lock_guard<std::mutex> guard(lock);
+    t.ns = retired.ns;
+    t.running_ns = 0;
+    t.calls = retired.calls;
+    t.threads = retired.threads;
+    t.samples = retired.samples;
+    retired.ns = retired.calls = retired.threads = 0;
+    retired.samples.clear();
+    for(size_t i = 0; i < shards.size(); ++i) {
+        profiler_shard *s = shards[i];
+        uint64_t started = s->started.load(std::memory_order_relaxed);
+        uint64_t total = s->total_ns.load(std::memory_order_relaxed);
+        uint64_t c = s->calls.load(std::memory_order_relaxed);
+        if(c == s->base_calls && !started) continue;
+        t.ns += total - s->base_ns;
+        t.calls += c - s->base_calls;
+        s->base_ns = total;
+        s->base_calls = c;
+        ++t.threads;
+        for(size_t b = 0; b < histogram::size; ++b) {
+            uint64_t n = s->samples[b].load(std::memory_order_relaxed);
+            if(n == s->base_samples[b]) continue;
+            t.samples.add(b, n - s->base_samples[b]);
+            s->base_samples[b] = n;
+        }
+        if(started) {
+            // section in progress is reported but not taken off
+            uint64_t now = tick_clock::ticks();
+            if(now > started) t.running_ns += tick_clock::to_ns(now - started);
+        }
+    }
+    t.ns += t.running_ns;
+}
+
+string profiler_label::dump(const char *name) {
+    totals t;
+    collect(t);
+    std::ostringstream os;
+    os << human_readable_number((double) t.ns / 1000000000) << "s\t" << name <<
+        " (" << t.calls << " calls, " << t.threads << " threads)";
+    const histogram &h = t.samples;
+    if(h.count())
+        os << "\n\tmin " << human_readable_duration(h.min()) <<
+            "  mean " << human_readable_duration(t.calls ? (t.ns - t.running_ns) / t.calls : 0) <<
+            "  p50 " << human_readable_duration(h.percentile(0.5)) <<
+            "  p90 " << human_readable_duration(h.percentile(0.9)) <<
+            "  p99 " << human_readable_duration(h.percentile(0.99)) <<
+            "  p99.9 " << human_readable_duration(h.percentile(0.999)) <<
+            "  max " << human_readable_duration(h.max());
+    return os.str();
+}
+
+void profiler_label::reset() {
+    totals t;
+    collect(t);
+}
+
+string profiler_table() {
+    std::vector<profiler_label*> current;
+    {
+        registry &r = labels();
+        std::lock_guard<std::mutex> guard(r.lock);
+        current = r.labels;
+    }
+    std::vector<profiler_label::totals> totals(current.size());
+    std::vector<size_t> rows;
+    for(size_t i = 0; i < current.size(); ++i) {
+        current[i]->collect(totals[i]);
+        if(totals[i].threads) rows.push_back(i);
+    }
+    if(rows.empty()) return string();
+    std::sort(rows.begin(), rows.end(),
+            [&totals] (size_t a, size_t b) { return totals[a].ns > totals[b].ns; });
+    std::ostringstream os;
+    os << "profile of " << rows.size() << " labels\n" << std::right <<
+        std::setw(10) << "total" << std::setw(12) << "calls" << std::setw(8) << "threads" <<
+        std::setw(9) << "min" << std::setw(9) << "mean" << std::setw(9) << "p50" <<
+        std::setw(9) << "p90" << std::setw(9) << "p99" << std::setw(9) << "p99.9" <<
+        std::setw(9) << "max" << "  label";
+    for(size_t i = 0; i < rows.size(); ++i) {
+        const profiler_label::totals &t = totals[rows[i]];
+        const histogram &h = t.samples;
+        os << "\n" << std::setw(10) << human_readable_number((double) t.ns / 1000000000) + "s" <<
+            std::setw(12) << t.calls << std::setw(8) << t.threads;
+        if(h.count())
+            os << std::setw(9) << human_readable_duration(h.min()) <<
+                std::setw(9) << human_readable_duration(t.calls ? (t.ns - t.running_ns) / t.calls : 0) <<
+                std::setw(9) << human_readable_duration(h.percentile(0.5)) <<
+                std::setw(9) << human_readable_duration(h.percentile(0.9)) <<
+                std::setw(9) << human_readable_duration(h.percentile(0.99)) <<
+                std::setw(9) << human_readable_duration(h.percentile(0.999)) <<
+                std::setw(9) << human_readable_duration(h.max());
+        else
+            for(size_t j = 0; j < 7; ++j) os << std::setw(9) << "-";
+        os << "  " << current[rows[i]]->label_name();
+    }
+    return os.str();
+}
+
+namespace {
+
+// plain tree all thread trees are summed into for output
+struct merged_node {
+    merged_node() : calls(0), inclusive_ns(0) {}
+    uint64_t calls;
+    uint64_t inclusive_ns;
+    std::map<profiler_label*, merged_node> children;
+};
+
+struct trees {
+    std::mutex lock;
+    std::vector<scope_tree*> live;
+    merged_node retired;
+};
+
+trees &scope_trees() {
+    static trees t;
+    return t;
+}
+
+void merge(merged_node &to, const scope_node *from) {
+    for(scope_node *c = from->first_child.load(std::memory_order_acquire); c;
+            c = c->next_sibling.load(std::memory_order_relaxed)) {
+        merged_node &m = to.children[c->label];
+        m.calls += c->calls.load(std::memory_order_relaxed);
+        m.inclusive_ns += c->inclusive_ns.load(std::memory_order_relaxed);
+        merge(m, c);
+    }
+}
+
+void merged_tree(merged_node &root) {
+    trees &t = scope_trees();
+    std::lock_guard<std::mutex> guard(t.lock);
+    root = t.retired;
+    for(size_t i = 0; i < t.live.size(); ++i)
+        merge(root, &t.live[i]->root);
+}
+
+uint64_t exclusive_ns(const merged_node &n) {
+    uint64_t children = 0;
+    for(std::map<profiler_label*, merged_node>::const_iterator it = n.children.begin(); it != n.children.end(); ++it)
+        children += it->second.inclusive_ns;
+    return n.inclusive_ns > children ? n.inclusive_ns - children : 0;
+}
+
+void print_tree(std::ostream &os, const merged_node &n, size_t depth) {
+    std::vector<std::pair<uint64_t, std::map<profiler_label*, merged_node>::const_iterator> > order;
+    for(std::map<profiler_label*, merged_node>::const_iterator it = n.children.begin(); it != n.children.end(); ++it)
+        order.push_back(std::make_pair(it->second.inclusive_ns, it));
+    std::sort(order.begin(), order.end(),
+            [] (const std::pair<uint64_t, std::map<profiler_label*, merged_node>::const_iterator> &a,
+                const std::pair<uint64_t, std::map<profiler_label*, merged_node>::const_iterator> &b) {
+                return a.first > b.first; });
+    for(size_t i = 0; i < order.size(); ++i) {
+        const merged_node &c = order[i].second->second;
+        os << "\n" << std::setw(10) << human_readable_duration(c.inclusive_ns) <<
+            std::setw(10) << human_readable_duration(exclusive_ns(c)) << std::setw(12) << c.calls <<
+            "  " << string(depth * 2, ' ') << order[i].second->first->label_name();
+        print_tree(os, c, depth + 1);
+    }
+}
+
+void print_folded(std::ostream &os, const merged_node &n, const string &path) {
+    for(std::map<profiler_label*, merged_node>::const_iterator it = n.children.begin(); it != n.children.end(); ++it) {
+        string p = path.empty() ? string(it->first->label_name()) : path + ";" + it->first->label_name();
+        if(uint64_t e = exclusive_ns(it->second)) os << p << ' ' << e << '\n';
+        print_folded(os, it->second, p);
+    }
+}
+
+}
+
+scope_node::~scope_node() {
+    scope_node *c = first_child.load(std::memory_order_relaxed);
+    while(c) {
+        scope_node *next = c->next_sibling.load(std::memory_order_relaxed);
+        delete c;
+        c = next;
+    }
+}
+
+scope_tree::scope_tree() : root(0, 0), current(&root) {
+    trees &t = scope_trees();
+    std::lock_guard<std::mutex> guard(t.lock);
+    t.live.push_back(this);
+}
+
+scope_tree::~scope_tree() {
+    trees &t = scope_trees();
+    std::lock_guard<std::mutex> guard(t.lock);
+    merge(t.retired, &root);
+    t.live.erase(std::find(t.live.begin(), t.live.end(), this));
+}
+
+string profiler_call_tree() {
+    merged_node root;
+    merged_tree(root);
+    std::ostringstream os;
+    os << "call tree\n" << std::setw(10) << "inclusive" << std::setw(10) << "exclusive" <<
+        std::setw(12) << "calls" << "  label";
+    print_tree(os, root, 0);
+    return os.str();
+}
+
+string profiler_folded_stacks() {
+    merged_node root;
+    merged_tree(root);
+    std::ostringstream os;
+    print_folded(os, root, string());
+    return os.str();
+}
+
+bool profiler_write_folded_stacks(const char *file_name) {
+    std::ofstream out(file_name);
+    out << profiler_folded_stacks();
+    return (bool) out.flush();
+}
+
+}
@@ -2,38 +2,223 @@
 #define EGER_PROFILER_H
 
 #include <iomanip>
+#include <atomic>
+#include <mutex>
+#include <vector>
 #include <eger/timer.h>
 #include <eger/named_instance.h>
 #include <eger/logger.h>
 #include <eger/formatter.h>
+#include <eger/histogram.h>
 
 namespace eger {
 
+class profiler_label;
+
+// counters of one label in one thread, only the owning thread writes them,
+// atomics are for relaxed loads and stores only so dumping thread reads whole values
+struct profiler_shard {
+    profiler_shard() : started(0), total_ns(0), calls(0), base_ns(0), base_calls(0), label(0) {
+        for(size_t i = 0; i < histogram::size; ++i) samples[i].store(0, std::memory_order_relaxed);
+        memset(base_samples, 0, sizeof(base_samples));
+    }
+    ~profiler_shard();
+
+    void start() { started.store(tick_clock::ticks(), std::memory_order_relaxed); }
+
+    void stop() {
+        uint64_t s = started.load(std::memory_order_relaxed);
+        if(!s) return;
+        record(tick_clock::to_ns(tick_clock::ticks() - s));
+        started.store(0, std::memory_order_relaxed);
+    }
+
+    void record(uint64_t ns) {
+        total_ns.store(total_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        std::atomic<uint64_t> &b = samples[histogram::bucket(ns)];
+        b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        calls.store(calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> started;      // ticks, 0 when stopped
+    std::atomic<uint64_t> total_ns;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> samples[histogram::size];
+    uint64_t base_ns;                   // already dumped, owned by label
+    uint64_t base_calls;
+    uint64_t base_samples[histogram::size];
+    profiler_label *label;
+};
+
+// process wide side of a label: shards of live threads and what exited ones left
+class profiler_label {
+    public:
+    profiler_label() : name(0) {
+        retired.ns = retired.running_ns = retired.calls = retired.threads = 0;
+    }
+
+    // first shard ever attached puts the label to the registry under its name
+    void attach(profiler_shard *s, const char *_name);
+    void detach(profiler_shard *s);
+
+    struct totals {
+        uint64_t ns;
+        uint64_t running_ns;    // part of ns in sections not finished yet
+        uint64_t calls;
+        size_t threads;
+        histogram samples;      // finished sections only
+    };
+
+    // "<seconds>s\t<name> (<calls> calls, <threads> threads)" and a line of
+    // min, mean, percentiles and max since last dump, running sections count up to now
+    string dump(const char *name);
+    void reset();
+    void collect(totals &t);
+
+    const char *label_name() const { return name; }
+
+    private:
+    std::mutex lock;
+    std::vector<profiler_shard*> shards;
+    totals retired;
+    const char *name;
+};
+
+inline profiler_shard &attached_shard(profiler_shard &s, profiler_label &l, const char *name) {
+    if(!s.label) l.attach(&s, name);
+    return s;
+}
+
+// every label used so far, one row each sorted by total time, labels with
+// nothing since last dump are skipped, empty string when no rows; resets all labels
+string profiler_table();
+
+// node of a per thread call tree of profiler scopes, children are only added
+// by the owning thread and published with release, so other threads may walk it
+struct scope_node {
+    scope_node(profiler_label *_label, scope_node *_parent) :
+        label(_label), parent(_parent), first_child(0), next_sibling(0), calls(0), inclusive_ns(0) {}
+    ~scope_node();
+
+    scope_node *child(profiler_label *l) {
+        scope_node *first = first_child.load(std::memory_order_relaxed);
+        for(scope_node *c = first; c; c = c->next_sibling.load(std::memory_order_relaxed))
+            if(c->label == l) return c;
+        scope_node *c = new scope_node(l, this);
+        c->next_sibling.store(first, std::memory_order_relaxed);
+        first_child.store(c, std::memory_order_release);
+        return c;
+    }
+
+    void add(uint64_t ns) {
+        inclusive_ns.store(inclusive_ns.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        calls.store(calls.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    profiler_label *label;
+    scope_node *parent;
+    std::atomic<scope_node*> first_child;
+    std::atomic<scope_node*> next_sibling;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> inclusive_ns;
+};
+
+// registered on first scope of a thread, merged into process wide tree on exit
+struct scope_tree {
+    scope_tree();
+    ~scope_tree();
+    scope_node root;
+    scope_node *current;
+};
+
+inline scope_tree &local_scope_tree() {
+    static thread_local scope_tree t;
+    return t;
+}
+
+// times its lifetime into the call tree of the thread and into the flat label
+class profiler_scope_guard {
+    public:
+    profiler_scope_guard(profiler_shard *_shard) : shard(_shard) {
+        if(!shard) return;
+        tree = &local_scope_tree();
+        node = tree->current->child(shard->label);
+        tree->current = node;
+        start = tick_clock::ticks();
+    }
+
+    ~profiler_scope_guard() {
+        if(!shard) return;
+        uint64_t ns = tick_clock::to_ns(tick_clock::ticks() - start);
+        node->add(ns);
+        shard->record(ns);
+        tree->current = node->parent;
+    }
+
+    private:
+    profiler_scope_guard(const profiler_scope_guard &);
+
+    profiler_shard *shard;
+    scope_tree *tree;
+    scope_node *node;
+    uint64_t start;
+};
+
+// call tree of all threads with inclusive and exclusive time and calls per path,
+// since the start of the process
+string profiler_call_tree();
+
+// the same tree as "outer;inner;leaf <exclusive ns>" lines, input of flamegraph.pl
+string profiler_folded_stacks();
+bool profiler_write_folded_stacks(const char *file_name);
+
+#define profiler_shard_of(named_inst) \
+    eger::attached_shard(thread_named_instance(eger::profiler_shard, named_inst), \
+            named_instance(eger::profiler_label, named_inst), #named_inst)
+
+#if EGER_MIN_LEVEL >= EGER_LEVEL_PROFILE
 #define profiler_start(named_inst) \
     (eger::is_using_this_level(eger::level_profile) ? \
-        named_instance(eger::timer, named_inst).start(), 0 : 0)
+        profiler_shard_of(named_inst).start(), 0 : 0)
 
 #define profiler_stop(named_inst) \
     (eger::is_using_this_level(eger::level_profile) ? \
-        named_instance(eger::timer, named_inst).stop(), 0 : 0)
+        profiler_shard_of(named_inst).stop(), 0 : 0)
 
 #define profiler_reset(named_inst) \
     (eger::is_using_this_level(eger::level_profile) ? \
-        named_instance(eger::timer, named_inst).reset(), 0 : 0)
+        named_instance(eger::profiler_label, named_inst).reset(), 0 : 0)
 
 #define profiler_dump(named_inst) \
     (eger::is_using_this_level(eger::level_profile) ? \
-        log_profile_multiline(eger::human_readable_number( \
-            ((double) (named_instance(eger::timer, named_inst).total()) / 1000000)) << \
-            "s\t" << #named_inst), \
-        named_instance(eger::timer, named_inst).reset(), 0 : 0)
+        log_profile_multiline(named_instance(eger::profiler_label, named_inst).dump(#named_inst)), 0 : 0)
+
+#define profiler_dump_all() \
+    (eger::is_using_this_level(eger::level_profile) ? \
+        log_profile_multiline(eger::profiler_table()), 0 : 0)
+
+#define profiler_scope(named_inst) \
+    eger::profiler_scope_guard profiler_scope_guard_##named_inst( \
+        eger::is_using_this_level(eger::level_profile) ? &profiler_shard_of(named_inst) : 0)
+
+#define profiler_dump_tree() \
+    (eger::is_using_this_level(eger::level_profile) ? \
+        log_profile_multiline(eger::profiler_call_tree()), 0 : 0)
 
 #define profiler_dump_2(named_inst, extra) \
     (eger::is_using_this_level(eger::level_profile) ? \
-        log_profile_multiline(eger::human_readable_number( \
-            ((double) (named_instance(eger::timer, named_inst).total()) / 1000000)) << \
-            "s\t" << #named_inst << " (" << extra << ")"), \
-        named_instance(eger::timer, named_inst).reset(), 0 : 0)
+        log_profile_multiline(named_instance(eger::profiler_label, named_inst).dump(#named_inst) << \
+            " (" << extra << ")"), 0 : 0)
+#else
+#define profiler_start(named_inst) ((void) 0)
+#define profiler_stop(named_inst) ((void) 0)
+#define profiler_reset(named_inst) ((void) 0)
+#define profiler_dump(named_inst) ((void) 0)
+#define profiler_dump_all() ((void) 0)
+#define profiler_scope(named_inst) ((void) 0)
+#define profiler_dump_tree() ((void) 0)
+#define profiler_dump_2(named_inst, extra) ((void) 0)
+#endif
 
 }
 
@@ -0,0 +1,339 @@
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <algorithm>
+#include <mutex>
+#include <deque>
+#include "recorder.h"
+#include "logger.h"
+
+namespace eger {
+
+namespace {
+
+// rings of exited threads are kept for dumps, oldest are freed above this
+const size_t maximum_exited_rings = 64;
+// rings and distinct formats a dump takes, it has no memory of its own but statics
+const size_t maximum_dumped_rings = 1024;
+const size_t maximum_dumped_formats = 1024;
+// an entry is its size, format descriptor and a record as in binary logs
+const size_t entry_header = sizeof(uint32_t) + sizeof(const format_descriptor*);
+// offset of the record's time, after 'R', id and level
+const size_t record_ns = 1 + sizeof(uint32_t) + 1;
+
+struct rings {
+    std::mutex lock;
+    std::deque<flight_ring*> all;
+    size_t exited;
+};
+
+rings &flight_rings() {
+    static rings r;
+    return r;
+}
+
+struct flight_ring_holder {
+    flight_ring_holder() : ring(0) {}
+    ~flight_ring_holder();
+    flight_ring *ring;
+};
+
+flight_ring_holder::~flight_ring_holder() {
+    if(!ring) return;
+    rings &r = flight_rings();
+    std::lock_guard<std::mutex> guard(r.lock);
+    ring->exited = true;
+    if(++r.exited <= maximum_exited_rings) return;
+    for(std::deque<flight_ring*>::iterator it = r.all.begin(); it != r.all.end(); ++it)
+        if((*it)->exited) {
+            delete *it;
+            r.all.erase(it);
+            --r.exited;
+            break;
+        }
+}
+
+flight_ring &local_flight_ring() {
+    static thread_local flight_ring_holder h;
+    if(!h.ring) {
+        h.ring = new flight_ring(instance::get_instance().flight_recorder_size);
+        rings &r = flight_rings();
+        std::lock_guard<std::mutex> guard(r.lock);
+        r.all.push_back(h.ring);
+    }
+    return *h.ring;
+}
+
+std::atomic<bool> dumping(false);
+std::atomic<int64_t> last_critical_dump(0);
+std::atomic<bool> dump_requested(false);
+
+// path of the dump being written, there is one at a time
+char dump_path[4096];
+
+char *put_decimal(char *p, uint64_t v) {
+    char digits[20];
+    size_t n = 0;
+    do digits[n++] = '0' + v % 10; while(v /= 10);
+    while(n) *p++ = digits[--n];
+    return p;
+}
+
+// every dump gets its own "base.<unix time>-<n>" so that a later one doesn't
+// erase an earlier incident, no library calls but syscalls for signal handlers
+int create_dump_file(const char *base) {
+    size_t l = strlen(base);
+    if(l + 48 > sizeof(dump_path)) return -1;
+    memcpy(dump_path, base, l);
+    uint64_t now = time(0);
+    for(uint64_t n = 0; n < 1000; ++n) {
+        char *p = dump_path + l;
+        *p++ = '.';
+        p = put_decimal(p, now);
+        *p++ = '-';
+        p = put_decimal(p, n);
+        *p = 0;
+        int fd = open(dump_path, O_WRONLY | O_CREAT | O_EXCL, 0660);
+        if(fd >= 0 || errno != EEXIST) return fd;
+    }
+    return -1;
+}
+
+}
+
+flight_ring::flight_ring(size_t size) :
+    tid(syscall(SYS_gettid)),
+    exited(false),
+    locked(false),
+    data(new char[size]),
+    capacity(size),
+    head(0),
+    tail(0)
+{}
+
+flight_ring::~flight_ring() { delete[] data; }
+
+bool flight_ring::try_lock(size_t attempts) {
+    for(; attempts; --attempts)
+        if(!locked.exchange(true, std::memory_order_acquire)) return true;
+    return false;
+}
+
+void flight_ring::copy_in(uint64_t at, const void *from, size_t n) {
+    size_t o = at % capacity;
+    size_t first = std::min(n, capacity - o);
+    memcpy(data + o, from, first);
+    memcpy(data, (const char*) from + first, n - first);
+}
+
+void flight_ring::copy_out(uint64_t at, void *to, size_t n) const {
+    size_t o = at % capacity;
+    size_t first = std::min(n, capacity - o);
+    memcpy(to, data + o, first);
+    memcpy((char*) to + first, data, n - first);
+}
+
+void flight_ring::put(const log_stream *ls) {
+    static thread_local string record;
+    record.clear();
+    binary_record(record, 0, ls);
+    uint32_t n = entry_header + record.size();
+    if(n > capacity) return;
+    lock();
+    while(head + n - tail > capacity) {
+        uint32_t oldest;
+        copy_out(tail, &oldest, sizeof(oldest));
+        tail += oldest;
+    }
+    copy_in(head, &n, sizeof(n));
+    copy_in(head + sizeof(n), &ls->format, sizeof(ls->format));
+    copy_in(head + entry_header, record.data(), record.size());
+    head += n;
+    unlock();
+}
+
+void flight_record(log_stream *ls) {
+    local_flight_ring().put(ls);
+    log_stream_pool::release(ls);
+}
+
+// buffered output of a dump, statics only and write(2), so it works in a
+// signal handler, there is one dump at a time
+class flight_dump {
+    public:
+    flight_dump(int _fd) : fd(_fd), used(0), formats(0) {}
+
+    bool run() {
+        rings &r = flight_rings();
+        bool registry = false;
+        for(size_t i = 0; i < 100000 && !(registry = r.lock.try_lock()); ++i);
+        if(!registry) return false;
+        size_t n = 0;
+        for(size_t i = 0; i < r.all.size() && n < maximum_dumped_rings; ++i)
+            // a ring whose owner was stopped while putting is left out
+            if(r.all[i]->try_lock(100000)) {
+                taken[n] = r.all[i];
+                at[n++] = r.all[i]->tail;
+            }
+        put(binary_magic, sizeof(binary_magic));
+        while(true) {
+            // the oldest of entries next in every ring goes first
+            size_t next = n;
+            int64_t next_ns = 0;
+            for(size_t i = 0; i < n; ++i) {
+                if(at[i] == taken[i]->head) continue;
+                int64_t ns;
+                taken[i]->copy_out(at[i] + entry_header + record_ns, &ns, sizeof(ns));
+                if(next == n || ns < next_ns) {
+                    next = i;
+                    next_ns = ns;
+                }
+            }
+            if(next == n) break;
+            put_entry(*taken[next], at[next]);
+        }
+        for(size_t i = 0; i < n; ++i) taken[i]->unlock();
+        r.lock.unlock();
+        return flush();
+    }
+
+    private:
+    void put(const void *p, size_t n) {
+        while(n) {
+            if(used == sizeof(buffer)) flush();
+            size_t c = std::min(n, sizeof(buffer) - used);
+            memcpy(buffer + used, p, c);
+            used += c;
+            p = (const char*) p + c;
+            n -= c;
+        }
+    }
+
+    template <class type> void put_value(type t) { put(&t, sizeof(t)); }
+
+    void put_string(const char *s) {
+        uint32_t l = s ? strlen(s) : 0;
+        put_value(l);
+        put(s, l);
+    }
+
+    bool flush() {
+        const char *p = buffer;
+        while(used) {
+            ssize_t w = ::write(fd, p, used);
+            if(w < 0 && errno == EINTR) continue;
+            if(w <= 0) {
+                used = 0;
+                return false;
+            }
+            p += w;
+            used -= w;
+        }
+        return true;
+    }
+
+    // descriptors are written once per dump, above the limit before every record
+    uint32_t format_id(const format_descriptor *fd) {
+        if(!fd) return 0;
+        for(size_t i = 0; i < formats; ++i)
+            if(known[i] == fd) return i + 1;
+        uint32_t id = maximum_dumped_formats + 1;
+        if(formats < maximum_dumped_formats) {
+            known[formats] = fd;
+            id = ++formats;
+        }
+        put("D", 1);
+        put_value(id);
+        put_value((uint8_t) fd->lvl);
+        put_value((uint32_t) fd->line);
+        put_string(fd->file);
+        put_string(fd->format);
+        return id;
+    }
+
+    void put_entry(const flight_ring &ring, uint64_t &pos) {
+        uint32_t n;
+        const format_descriptor *fd;
+        ring.copy_out(pos, &n, sizeof(n));
+        ring.copy_out(pos + sizeof(n), &fd, sizeof(fd));
+        uint32_t id = format_id(fd);
+        put("R", 1);
+        put_value(id);
+        // the rest of the record is copied as it is
+        for(uint64_t from = pos + entry_header + 1 + sizeof(id), to = pos + n; from < to; ) {
+            char chunk[4096];
+            size_t c = std::min<uint64_t>(sizeof(chunk), to - from);
+            ring.copy_out(from, chunk, c);
+            put(chunk, c);
+            from += c;
+        }
+        pos += n;
+    }
+
+    int fd;
+    size_t used;
+    size_t formats;
+    static char buffer[64*1024];
+    static flight_ring *taken[maximum_dumped_rings];
+    static uint64_t at[maximum_dumped_rings];
+    static const format_descriptor *known[maximum_dumped_formats];
+};
+
+char flight_dump::buffer[64*1024];
+flight_ring *flight_dump::taken[maximum_dumped_rings];
+uint64_t flight_dump::at[maximum_dumped_rings];
+const format_descriptor *flight_dump::known[maximum_dumped_formats];
+
+bool flight_recorder_dump(const char *file_name) {
+    if(dumping.exchange(true, std::memory_order_acquire)) return false;
+    int fd = file_name ? open(file_name, O_WRONLY | O_CREAT | O_TRUNC, 0660) :
+        create_dump_file(instance::get_instance().flight_recorder_file.c_str());
+    bool ok = fd >= 0;
+    if(ok) {
+        flight_dump d(fd);
+        ok = d.run();
+        ::close(fd);
+    }
+    dumping.store(false, std::memory_order_release);
+    return ok;
+}
+
+void flight_recorder_critical() {
+    using namespace std::chrono;
+    int64_t now = duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+    int64_t last = last_critical_dump.load(std::memory_order_relaxed);
+    if(last && now - last < 1000) return;
+    if(!last_critical_dump.compare_exchange_strong(last, now, std::memory_order_relaxed)) return;
+    dump_requested.store(true, std::memory_order_release);
+}
+
+bool flight_recorder_requested() {
+    return dump_requested.load(std::memory_order_relaxed) && dump_requested.exchange(false, std::memory_order_acquire);
+}
+
+namespace {
+
+void on_fatal_signal(int sig) {
+    flight_recorder_dump();
+    // handler was reset, the default action follows
+    raise(sig);
+}
+
+}
+
+void flight_recorder_catch_signals() {
+    const int fatal[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_fatal_signal;
+    sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+    sigemptyset(&sa.sa_mask);
+    for(size_t i = 0; i < sizeof(fatal) / sizeof(fatal[0]); ++i)
+        sigaction(fatal[i], &sa, 0);
+}
+
+}
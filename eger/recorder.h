@@ -0,0 +1,62 @@
+#ifndef EGER_RECORDER_H
+#define EGER_RECORDER_H
+
+#include <atomic>
+#include <eger/types.h>
+
+namespace eger {
+
+// recent records of one thread at levels kept by the flight recorder,
+// encoded as in binary logs, the oldest are overwritten, only the owner
+// writes and a dump holds it for a moment
+class flight_ring {
+    public:
+    flight_ring(size_t size);
+    ~flight_ring();
+
+    void put(const log_stream *ls);
+
+    long tid;
+    bool exited;
+
+    private:
+    flight_ring(const flight_ring &);
+    friend class flight_dump;
+
+    void lock() { while(locked.exchange(true, std::memory_order_acquire)); }
+    bool try_lock(size_t attempts);
+    void unlock() { locked.store(false, std::memory_order_release); }
+    void copy_in(uint64_t at, const void *from, size_t n);
+    void copy_out(uint64_t at, void *to, size_t n) const;
+
+    std::atomic<bool> locked;
+    char *data;
+    size_t capacity;
+    uint64_t head;              // end of the newest entry, bytes ever written
+    uint64_t tail;              // start of the oldest one
+};
+
+// puts a record of a level without destination into the ring of this thread
+// and releases it
+void flight_record(log_stream *ls);
+
+// rings of all threads merged by time into a binary log for eger_decode,
+// a new instance's flight_recorder_file.<unix time>-<n> by default, given
+// file_name is overwritten, safe in a signal handler as long as the thread
+// it runs on isn't recording at the moment
+bool flight_recorder_dump(const char *file_name = 0);
+
+// asks for a dump for a critical record, once a second at most, writer
+// thread makes it, so the producer doesn't wait for file output
+void flight_recorder_critical();
+
+// true once after a request, for writer
+bool flight_recorder_requested();
+
+// SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT dump the rings and go on
+// with the default action
+void flight_recorder_catch_signals();
+
+}
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef EGER_RING_H
+#define EGER_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+namespace eger {
+
+// single producer / single consumer bounded ring
+// head is owned by producer, tail by consumer, both kept on own cache lines,
+// producer may also steal the oldest element of a full ring, so tail moves by CAS
+template <class type>
+class spsc_ring {
+    public:
+    spsc_ring(size_t size) :
+        head(0),
+        cached_tail(0),
+        tail(0),
+        cached_head(0)
+    {
+        size_t s = 1;
+        while(s < size) s <<= 1;
+        slots = new std::atomic<type>[s];
+        mask = s - 1;
+    }
+
+    ~spsc_ring() { delete[] slots; }
+
+    bool push(type v) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h - cached_tail > mask) {
+            cached_tail = tail.load(std::memory_order_acquire);
+            if(h - cached_tail > mask) return false;
+        }
+        slots[h & mask].store(v, std::memory_order_relaxed);
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(type &v) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        while(true) {
+            // tail may have passed a stale cached head after steals
+            if((intptr_t) (cached_head - t) <= 0) {
+                cached_head = head.load(std::memory_order_acquire);
+                if((intptr_t) (cached_head - t) <= 0) return false;
+            }
+            v = slots[t & mask].load(std::memory_order_relaxed);
+            if(tail.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+    // producer side, takes the oldest element out if accept agrees to,
+    // v is the oldest element whenever there is one
+    template <class predicate>
+    bool steal_if(type &v, predicate accept) {
+        size_t t = tail.load(std::memory_order_acquire);
+        while(t != head.load(std::memory_order_relaxed)) {
+            v = slots[t & mask].load(std::memory_order_relaxed);
+            if(!accept(v)) {
+                // consumer may have taken it meanwhile
+                size_t now = tail.load(std::memory_order_acquire);
+                if(now == t) return false;
+                t = now;
+            } else if(tail.compare_exchange_weak(t, t + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+                return true;
+        }
+        return false;
+    }
+
+    size_t depth() const {
+        return head.load(std::memory_order_relaxed) - tail.load(std::memory_order_relaxed);
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    private:
+    spsc_ring(const spsc_ring &);
+
+    char pad0[64];
+    std::atomic<size_t> head;
+    size_t cached_tail;
+    char pad1[64];
+    std::atomic<size_t> tail;
+    size_t cached_head;
+    char pad2[64];
+    std::atomic<type> *slots;
+    size_t mask;
+};
+
+// bounded multi producer / multi consumer queue, every cell carries
+// the position it is ready for, so a claimed but unfilled cell just
+// holds consumers back and is never skipped
+template <class type>
+class mpmc_ring {
+    public:
+    mpmc_ring(size_t size) :
+        head(0),
+        tail(0)
+    {
+        size_t s = 1;
+        while(s < size) s <<= 1;
+        cells = new cell[s];
+        mask = s - 1;
+        for(size_t i = 0; i < s; ++i)
+            cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    ~mpmc_ring() { delete[] cells; }
+
+    bool push(type v) {
+        size_t h = head.load(std::memory_order_relaxed);
+        while(true) {
+            cell &c = cells[h & mask];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t) seq - (intptr_t) h;
+            if(dif == 0) {
+                if(head.compare_exchange_weak(h, h + 1, std::memory_order_relaxed)) {
+                    c.value.store(v, std::memory_order_relaxed);
+                    c.seq.store(h + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(dif < 0)
+                return false;
+            else
+                h = head.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool pop(type &v) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        while(true) {
+            cell &c = cells[t & mask];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t) seq - (intptr_t) (t + 1);
+            if(dif == 0) {
+                if(tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+                    v = c.value.load(std::memory_order_relaxed);
+                    c.seq.store(t + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(dif < 0)
+                return false;
+            else
+                t = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    // pops the oldest element only if accept agrees to, v is the oldest
+    // element whenever there is one
+    template <class predicate>
+    bool pop_if(type &v, predicate accept) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        while(true) {
+            cell &c = cells[t & mask];
+            size_t seq = c.seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t) seq - (intptr_t) (t + 1);
+            if(dif == 0) {
+                v = c.value.load(std::memory_order_relaxed);
+                if(!accept(v)) {
+                    // another consumer may have taken it meanwhile
+                    size_t now = tail.load(std::memory_order_relaxed);
+                    if(now == t) return false;
+                    t = now;
+                } else if(tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+                    c.seq.store(t + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if(dif < 0)
+                return false;
+            else
+                t = tail.load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t depth() const {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t t = tail.load(std::memory_order_relaxed);
+        return h > t ? h - t : 0;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+    private:
+    mpmc_ring(const mpmc_ring &);
+
+    struct cell {
+        std::atomic<size_t> seq;
+        std::atomic<type> value;                // read by pop_if before the cell is claimed
+    };
+
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64];
+    std::atomic<size_t> tail;
+    char pad2[64];
+    cell *cells;
+    size_t mask;
+};
+
+}
+
+#endif
@@ -0,0 +1,396 @@
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <iostream>
+#include <deque>
+#include <map>
+#include <mutex>
+#include "sink.h"
+#include "writer.h"
+
+namespace eger {
+
+namespace {
+
+struct schemes {
+    std::mutex lock;
+    std::map<string, sink_factory> factories;
+};
+
+sink *create_mmap(const string &target, const sink_context &c);
+sink *create_unix(const string &target, const sink_context &) { return new socket_sink(target, false); }
+sink *create_unixgram(const string &target, const sink_context &) { return new socket_sink(target, true); }
+sink *create_memory(const string &target, const sink_context &c) { return new memory_sink(target, c.inst->memory_sink_size); }
+
+schemes &sink_schemes() {
+    static schemes s;
+    static bool built_in = false;
+    std::lock_guard<std::mutex> guard(s.lock);
+    if(!built_in) {
+        s.factories["mmap"] = create_mmap;
+        s.factories["unix"] = create_unix;
+        s.factories["unixgram"] = create_unixgram;
+        s.factories["memory"] = create_memory;
+        built_in = true;
+    }
+    return s;
+}
+
+// zero tail left by a crash is cut off on reopen, binary records may end
+// with zeros themselves, so they are always written
+sink *create_mmap(const string &target, const sink_context &c) { return new file_sink(target, c, !c.binary); }
+
+void warn(const string &what, const string &path) {
+    log_stream ls(level_warning);
+    char str_buf[256];
+    ls << what << " \"" << path << "\": " << strerror_r(errno, str_buf, sizeof(str_buf));
+    std::cerr << writer::compose_log_string(&ls, instance::get_instance().ansi_colors);
+}
+
+bool write_all(int fd, const char *p, size_t left, size_t &written, uint64_t &calls) {
+    while(left) {
+        ++calls;
+        ssize_t r = ::write(fd, p, left);
+        if(r < 0 && errno == EINTR) continue;
+        if(r <= 0) return false;
+        p += r;
+        left -= r;
+        written += r;
+    }
+    return true;
+}
+
+}
+
+void register_sink_scheme(const string &scheme, sink_factory factory) {
+    schemes &s = sink_schemes();
+    std::lock_guard<std::mutex> guard(s.lock);
+    s.factories[scheme] = factory;
+}
+
+sink *create_sink(const string &name, const sink_context &c) {
+    size_t colon = name.find(':');
+    if(colon != string::npos) {
+        schemes &s = sink_schemes();
+        sink_factory f = 0;
+        {
+            std::lock_guard<std::mutex> guard(s.lock);
+            std::map<string, sink_factory>::iterator it = s.factories.find(name.substr(0, colon));
+            if(it != s.factories.end()) f = it->second;
+        }
+        if(f) return f(name.substr(colon + 1), c);
+    }
+    if(name == "stdout") return new stream_sink(1);
+    if(name == "stderr") return new stream_sink(2);
+    return new file_sink(name, c, false);
+}
+
+void stream_sink::write(const sink_batch &batch) {
+    size_t written = 0;
+    write_all(fd, batch.data.data(), batch.data.size(), written, syscalls);
+}
+
+file_sink::file_sink(const string &_path, const sink_context &c, bool _mapped) :
+    path(_path),
+    inst(c.inst),
+    archives(c.archives),
+    fd(-1),
+    failed(false),
+    stuck(false),
+    written(0),
+    mapped(_mapped),
+    map(0),
+    map_size(0),
+    synced(0)
+{}
+
+bool file_sink::open(bool &started) {
+    started = false;
+    if(fd != -1) return true;
+    if(failed) return false;
+    fd = ::open(path.c_str(), (mapped ? O_RDWR : O_WRONLY | O_APPEND) | O_CREAT, 0660);
+    if(fd < 0) {
+        warn("can't open file", path);
+        failed = true;
+        return false;
+    }
+    off_t s = lseek(fd, 0, SEEK_END);
+    written = s > 0 ? s : 0;
+    if(mapped && map_file(written)) {
+        while(written && !map[written - 1]) --written;
+        synced = written;
+    }
+    if(written > inst->maximum_log_size && !stuck && rotate()) return open(started);
+    started = written == 0;
+    return true;
+}
+
+void file_sink::write(const sink_batch &batch) {
+    const string &data = batch.data;
+    if(map) {
+        if(written + data.size() <= map_size || map_file(written + data.size())) {
+            memcpy(map + written, data.data(), data.size());
+            written += data.size();
+            return;
+        }
+        // file can't grow or be mapped, the rest goes through write(2)
+        lseek(fd, written, SEEK_SET);
+        ++syscalls;
+    }
+    write_all(fd, data.data(), data.size(), written, syscalls);
+}
+
+void file_sink::flush() {
+    failed = false;
+    if(map && inst->mmap_sync_interval.count() &&
+            std::chrono::steady_clock::now() - last_sync >= inst->mmap_sync_interval)
+        sync_mapping();
+}
+
+// only renames, compression and removal of old archives are done by archiver,
+// a file that can't be renamed is reopened and appended to from then on
+bool file_sink::rotate() {
+    close();
+    if(!archives->rotate(path)) {
+        stuck = true;
+        return false;
+    }
+    written = 0;
+    return true;
+}
+
+void file_sink::close() {
+    unmap_file();
+    if(fd != -1) ::close(fd);
+    fd = -1;
+}
+
+// mapping covers the whole file, which is extended to a multiple of chunk,
+// on failure the sink falls back to write(2) with the file cut to written
+bool file_sink::map_file(size_t s) {
+    size_t chunk = inst->mmap_chunk_size ? inst->mmap_chunk_size : 1;
+    size_t new_size = (s / chunk + 1) * chunk;
+    if(map) munmap(map, map_size);
+    map = 0;
+    map_size = 0;
+    void *m = MAP_FAILED;
+    syscalls += 2;
+    if(ftruncate(fd, new_size) == 0)
+        m = mmap(0, new_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if(m == MAP_FAILED) {
+        mapped = false;
+        if(ftruncate(fd, written) < 0) {}
+        return false;
+    }
+    map = (char*) m;
+    map_size = new_size;
+    return true;
+}
+
+// records not synced yet reach the disk before the file is cut and closed
+void file_sink::unmap_file() {
+    if(!map) return;
+    sync_mapping();
+    munmap(map, map_size);
+    map = 0;
+    map_size = 0;
+    if(ftruncate(fd, written) < 0) {}
+}
+
+// pages written since the last sync are flushed to disk and dropped
+// from memory, page cache keeps them for readers
+void file_sink::sync_mapping() {
+    last_sync = std::chrono::steady_clock::now();
+    if(synced == written) return;
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t from = synced / page * page;
+    msync(map + from, written - from, MS_SYNC);
+    ++syscalls;
+    size_t whole = written / page * page;
+    if(whole > from) {
+        madvise(map + from, whole - from, MADV_DONTNEED);
+        ++syscalls;
+    }
+    synced = written;
+}
+
+namespace {
+
+// stream output waiting for a slow collector, beyond it batches are lost
+const size_t maximum_pending = 4*1024*1024;
+
+}
+
+socket_sink::socket_sink(const string &_path, bool _datagram) :
+    path(_path),
+    datagram(_datagram),
+    fd(-1),
+    lost(0),
+    complained(false)
+{}
+
+// a collector which is not there is looked for again in a second, records
+// written meanwhile are lost and counted, so writer never falls back to stderr
+bool socket_sink::open(bool &started) {
+    started = false;
+    if(fd != -1) return true;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(now < retry_at) return true;
+    retry_at = now + std::chrono::seconds(1);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        if(!complained) warn("can't connect to", path);
+        complained = true;
+        return true;
+    }
+    memcpy(addr.sun_path, path.data(), path.size());
+    fd = socket(AF_UNIX, (datagram ? SOCK_DGRAM : SOCK_STREAM) | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd >= 0 && connect(fd, (sockaddr*) &addr, sizeof(addr)) == 0) {
+        complained = false;
+        started = true;
+        return true;
+    }
+    if(!complained) warn("can't connect to", path);
+    complained = true;
+    close();
+    return true;
+}
+
+void socket_sink::write(const sink_batch &batch) {
+    if(fd == -1) {
+        lose(batch.ends.size());
+        return;
+    }
+    if(datagram) {
+        // a record per datagram
+        size_t from = 0;
+        for(size_t i = 0; i < batch.ends.size(); ++i) {
+            size_t to = batch.ends[i];
+            ssize_t r;
+            do ++syscalls, r = send(fd, batch.data.data() + from, to - from, MSG_DONTWAIT | MSG_NOSIGNAL);
+            while(r < 0 && errno == EINTR);
+            if(r < 0) {
+                if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EMSGSIZE && errno != ENOBUFS) {
+                    lose(batch.ends.size() - i);
+                    close();
+                    return;
+                }
+                lose(1);
+            }
+            from = to;
+        }
+        return;
+    }
+    if(pending.size() + batch.data.size() > maximum_pending) {
+        send_pending();
+        if(pending.size() + batch.data.size() > maximum_pending) {
+            lose(batch.ends.size());
+            return;
+        }
+    }
+    pending += batch.data;
+    send_pending();
+}
+
+bool socket_sink::send_pending() {
+    size_t sent = 0;
+    while(sent < pending.size()) {
+        ++syscalls;
+        ssize_t r = send(fd, pending.data() + sent, pending.size() - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(r < 0 && errno == EINTR) continue;
+        if(r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if(r <= 0) {
+            // what is left can't be cut at a record boundary, it is lost
+            // together with the connection
+            lose(1);
+            close();
+            return false;
+        }
+        sent += r;
+    }
+    pending.erase(0, sent);
+    return pending.empty();
+}
+
+void socket_sink::flush() {
+    if(fd != -1 && !pending.empty()) send_pending();
+    if(!lost) return;
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if(now - last_report < std::chrono::seconds(1)) return;
+    last_report = now;
+    log_stream ls(level_warning);
+    ls << "collector at \"" << path << "\" lost " << lost << " records";
+    std::cerr << writer::compose_log_string(&ls, instance::get_instance().ansi_colors);
+    lost = 0;
+}
+
+void socket_sink::close() {
+    if(fd != -1) ::close(fd);
+    fd = -1;
+    pending.clear();
+}
+
+void socket_sink::lose(size_t records) { lost += records; }
+
+struct memory_ring {
+    memory_ring(size_t _capacity) : capacity(_capacity) {}
+    std::mutex lock;
+    std::deque<string> records;
+    size_t capacity;
+};
+
+namespace {
+
+struct rings {
+    std::mutex lock;
+    std::map<string, memory_ring*> by_name;
+};
+
+rings &memory_rings() {
+    static rings r;
+    return r;
+}
+
+memory_ring *find_ring(const string &name, size_t capacity) {
+    rings &r = memory_rings();
+    std::lock_guard<std::mutex> guard(r.lock);
+    memory_ring *&found = r.by_name[name];
+    if(!found) found = new memory_ring(capacity);
+    return found;
+}
+
+}
+
+memory_sink::memory_sink(const string &name, size_t capacity) :
+    records(find_ring(name, capacity))
+{}
+
+void memory_sink::write(const sink_batch &batch) {
+    std::lock_guard<std::mutex> guard(records->lock);
+    size_t from = 0;
+    for(size_t i = 0; i < batch.ends.size(); ++i) {
+        records->records.push_back(batch.data.substr(from, batch.ends[i] - from));
+        from = batch.ends[i];
+        if(records->records.size() > records->capacity) records->records.pop_front();
+    }
+}
+
+std::vector<string> memory_sink_records(const string &name) {
+    memory_ring *r = find_ring(name, instance::get_instance().memory_sink_size);
+    std::lock_guard<std::mutex> guard(r->lock);
+    return std::vector<string>(r->records.begin(), r->records.end());
+}
+
+void memory_sink_clear(const string &name) {
+    memory_ring *r = find_ring(name, instance::get_instance().memory_sink_size);
+    std::lock_guard<std::mutex> guard(r->lock);
+    r->records.clear();
+}
+
+}
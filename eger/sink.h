@@ -0,0 +1,148 @@
+#ifndef EGER_SINK_H
+#define EGER_SINK_H
+
+#include <stdint.h>
+#include <chrono>
+#include <vector>
+#include <eger/types.h>
+
+namespace eger {
+
+class instance;
+class archiver;
+struct memory_ring;
+
+// whole records collected by writer, record i ends at ends[i]
+struct sink_batch {
+    sink_batch(const string &_data, const std::vector<size_t> &_ends) : data(_data), ends(_ends) {}
+    const string &data;
+    const std::vector<size_t> &ends;
+};
+
+// where a destination's records go, used by writer thread only
+class sink {
+    public:
+    sink() : syscalls(0) {}
+    virtual ~sink() {}
+
+    // called before every record, started is set when a new empty output
+    // was begun and headers have to go first, false sends the record to stderr
+    virtual bool open(bool &started) = 0;
+    virtual void write(const sink_batch &batch) = 0;
+    virtual void flush() {}                     // end of every writer cycle
+    virtual bool rotate() { return true; } // false when output is kept as it is
+    virtual void close() {}
+
+    virtual bool rotatable() const { return false; } // size is limited by maximum_log_size
+    virtual size_t size() const { return 0; }   // bytes in current output
+    virtual bool immediate() const { return false; } // gets every record right away, not batches
+
+    uint64_t syscalls;                          // made for output so far, counted by sink
+};
+
+struct sink_context {
+    instance *inst;
+    archiver *archives;
+    bool binary;                                // records are binary, not lines
+};
+
+// target is a destination name without its scheme and layout prefixes
+typedef sink *(*sink_factory)(const string &target, const sink_context &c);
+
+// destinations named "scheme:target" get sinks of factory, built-in schemes
+// are mmap, unix, unixgram and memory, anything else is a file path, stdout or stderr
+void register_sink_scheme(const string &scheme, sink_factory factory);
+sink *create_sink(const string &name, const sink_context &c);
+
+// stdout or stderr
+class stream_sink : public sink {
+    public:
+    stream_sink(int _fd) : fd(_fd) {}
+    bool open(bool &started) { started = false; return true; }
+    void write(const sink_batch &batch);
+
+    private:
+    int fd;
+};
+
+// file rotated by archiver, with mapped set it is extended by chunks and
+// mapped, records are copied into the mapping and the file is cut to its
+// real length on close
+class file_sink : public sink {
+    public:
+    file_sink(const string &_path, const sink_context &c, bool _mapped);
+    ~file_sink() { close(); }
+
+    bool open(bool &started);
+    void write(const sink_batch &batch);
+    void flush();
+    bool rotate();
+    void close();
+
+    bool rotatable() const { return !stuck; }
+    size_t size() const { return written; }
+    bool immediate() const { return map != 0; }
+
+    private:
+    bool map_file(size_t size);
+    void unmap_file();
+    void sync_mapping();
+
+    string path;
+    instance *inst;
+    archiver *archives;
+    int fd;
+    bool failed;                                // not retried till the next cycle
+    bool stuck;                                 // rename failed, file grows past maximum_log_size
+    size_t written;                             // size of the file, counted instead of asked for
+    bool mapped;
+    char *map;
+    size_t map_size;
+    size_t synced;                              // mapped bytes msync'ed already
+    std::chrono::steady_clock::time_point last_sync;
+};
+
+// local collector on a unix domain socket, never blocks writer: stream
+// output not accepted is kept up to a limit, datagrams are dropped
+class socket_sink : public sink {
+    public:
+    socket_sink(const string &_path, bool _datagram);
+    ~socket_sink() { close(); }
+
+    bool open(bool &started);
+    void write(const sink_batch &batch);
+    void flush();
+    void close();
+
+    private:
+    bool send_pending();
+    void lose(size_t records);
+
+    string path;
+    bool datagram;
+    int fd;
+    string pending;                             // stream bytes not sent yet
+    size_t lost;
+    bool complained;                            // about collector not being there
+    std::chrono::steady_clock::time_point retry_at;
+    std::chrono::steady_clock::time_point last_report;
+};
+
+// last records of "memory:name" destinations kept in a bounded ring,
+// the ring outlives writer so tests may look at it afterwards
+class memory_sink : public sink {
+    public:
+    memory_sink(const string &name, size_t capacity);
+    bool open(bool &started) { started = false; return true; }
+    void write(const sink_batch &batch);
+
+    private:
+    memory_ring *records;
+};
+
+std::vector<string> memory_sink_records(const string &name);
+void memory_sink_clear(const string &name);
+
+}
+
+#endif
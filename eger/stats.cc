@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <mutex>
+#include <deque>
+#include <sstream>
+#include "stats.h"
+
+namespace eger {
+
+namespace {
+
+struct producers {
+    std::mutex lock;
+    std::deque<producer_counters*> all;
+    producer_stats exited;                      // sums of threads gone
+};
+
+producers &producer_registry() {
+    static producers p;
+    return p;
+}
+
+void add_up(producer_stats &s, const producer_counters &c) {
+    s.pushed += c.pushed.load(std::memory_order_relaxed);
+    s.dropped += c.dropped.load(std::memory_order_relaxed);
+    s.blocked += c.blocked.load(std::memory_order_relaxed);
+    s.deepest_queue = std::max(s.deepest_queue, c.deepest_queue.load(std::memory_order_relaxed));
+}
+
+struct producer_counters_holder {
+    producer_counters_holder() : counters(0) {}
+    ~producer_counters_holder();
+    producer_counters *counters;
+};
+
+producer_counters_holder::~producer_counters_holder() {
+    if(!counters) return;
+    producers &p = producer_registry();
+    std::lock_guard<std::mutex> guard(p.lock);
+    add_up(p.exited, *counters);
+    p.all.erase(std::find(p.all.begin(), p.all.end(), counters));
+    delete counters;
+}
+
+}
+
+producer_counters &local_producer_counters() {
+    static thread_local producer_counters_holder h;
+    if(!h.counters) {
+        h.counters = new producer_counters;
+        producers &p = producer_registry();
+        std::lock_guard<std::mutex> guard(p.lock);
+        p.all.push_back(h.counters);
+    }
+    return *h.counters;
+}
+
+producer_stats producer_totals() {
+    producers &p = producer_registry();
+    std::lock_guard<std::mutex> guard(p.lock);
+    producer_stats s = p.exited;
+    for(size_t i = 0; i < p.all.size(); ++i) add_up(s, *p.all[i]);
+    return s;
+}
+
+string stats_summary(const logger_stats &s) {
+    std::ostringstream os;
+    os << "eger pushed " << s.producers.pushed << ", dropped " << s.producers.dropped <<
+        ", blocked " << s.producers.blocked << ", deepest queue " << s.producers.deepest_queue;
+    for(size_t i = 0; i < s.writers.size(); ++i) {
+        const writer_stats &w = s.writers[i];
+        os << "; shard " << i << " queue " << w.queue_depth << "/" << w.queue_capacity <<
+            ", " << w.records << " records in " << w.cycles << " cycles, largest " << w.largest_batch <<
+            ", format " << (w.records ? w.format_ns / w.records : 0) << " ns/record";
+        uint64_t writes = 0;
+        for(size_t j = 0; j < w.destinations.size(); ++j) writes += w.destinations[j].writes;
+        os << ", write " << (writes ? w.write_ns / writes / 1000 : 0) << " us avg " <<
+            w.longest_write_ns / 1000 << " us max";
+        for(size_t j = 0; j < w.destinations.size(); ++j) {
+            const destination_stats &d = w.destinations[j];
+            os << "; " << d.name << " " << d.records << " records, " << d.bytes << " bytes, " <<
+                d.writes << " writes, " << d.syscalls << " syscalls";
+            if(d.rotations) os << ", " << d.rotations << " rotations";
+            if(d.failures) os << ", " << d.failures << " failures";
+            if(d.suppressed) os << ", " << d.suppressed << " suppressed";
+        }
+    }
+    return os.str();
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef EGER_STATS_H
+#define EGER_STATS_H
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <eger/types.h>
+
+namespace eger {
+
+// counters of one destination since writer opened it
+struct destination_stats {
+    destination_stats() : records(0), bytes(0), writes(0), syscalls(0), rotations(0), failures(0), suppressed(0) {}
+    string name;
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t writes;                            // batches given to sink
+    uint64_t syscalls;                          // write(2), send(2), msync(2) and alike of sink
+    uint64_t rotations;
+    uint64_t failures;                          // records sent to stderr, sink couldn't be opened
+    uint64_t suppressed;                        // repeats counted instead of written, see dedup_window
+};
+
+// counters of one writer shard, an asynchronous writer publishes them
+// at the end of every cycle with records
+struct writer_stats {
+    writer_stats() : queue_depth(0), queue_capacity(0), cycles(0), records(0),
+        largest_batch(0), format_ns(0), write_ns(0), longest_write_ns(0) {}
+    size_t queue_depth;                         // records waiting at the moment of snapshot
+    size_t queue_capacity;                      // of every producer thread with per_thread_queues
+    uint64_t cycles;                            // writer cycles with records
+    uint64_t records;                           // taken from queue
+    size_t largest_batch;                       // records of one cycle
+    uint64_t format_ns;                         // composing records
+    uint64_t write_ns;                          // in sinks
+    uint64_t longest_write_ns;
+    std::vector<destination_stats> destinations;
+};
+
+// summed over all producer threads, exited ones included
+struct producer_stats {
+    producer_stats() : pushed(0), dropped(0), blocked(0), deepest_queue(0) {}
+    uint64_t pushed;                            // records given to writers
+    uint64_t dropped;                           // by overflow policy
+    uint64_t blocked;                           // pushes waiting for room with overflow_block
+    size_t deepest_queue;                       // depth a producer has seen after its push
+};
+
+struct logger_stats {
+    producer_stats producers;
+    std::vector<writer_stats> writers;          // by shard
+};
+
+// main figures in one line, writer puts it at level_profile every stats_interval
+string stats_summary(const logger_stats &s);
+
+// counters of the calling thread, it is the only one changing them, so
+// relaxed load and store are enough and no bus locking is involved
+struct producer_counters {
+    producer_counters() : pushed(0), dropped(0), blocked(0), deepest_queue(0) {}
+
+    static void add(std::atomic<uint64_t> &c) {
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void seen_depth(size_t depth) {
+        if(depth > deepest_queue.load(std::memory_order_relaxed))
+            deepest_queue.store(depth, std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t> pushed;
+    std::atomic<uint64_t> dropped;
+    std::atomic<uint64_t> blocked;
+    std::atomic<size_t> deepest_queue;
+};
+
+producer_counters &local_producer_counters();
+producer_stats producer_totals();
+
+}
+
+#endif
@@ -1,8 +1,9 @@
 #ifndef EGER_TIMER_H
 #define EGER_TIMER_H
 
-#include <sys/time.h>
 #include <stdlib.h>
+#include <ostream>
+#include <eger/clock.h>
 
 namespace eger {
 
@@ -22,48 +23,37 @@ namespace eger {
         timer *tmr;
     };
 
+    // intervals are measured in ticks of tick_clock (see clock.h) and summed up
+    // in nanoseconds, microsecond interface is kept for compatibility
     class timer {
         public:
-        timer() { reset(); }
+        timer() : deadline_ns(0) { reset(); }
 
-        void start() { gettimeofday(&start_time, NULL); }
+        void start() { start_ticks = tick_clock::ticks(); }
 
-        size_t current() {
-            struct timeval now;
-            gettimeofday(&now, NULL);
-            size_t diff = (((size_t) now.tv_sec) * 1000000) + now.tv_usec - (((size_t) start_time.tv_sec) * 1000000) - start_time.tv_usec;
-            return diff;
-        }
+        uint64_t current_ns() { return tick_clock::to_ns(tick_clock::ticks() - start_ticks); }
+        size_t current() { return current_ns() / 1000; }
 
         size_t stop() {
-            previous_intervals += current();
+            previous_ns += current_ns();
             stopped_once = true;
-            return previous_intervals;
+            return previous_ns / 1000;
         }
 
-        size_t total() {
-            return stopped_once ? previous_intervals : current();
+        uint64_t total_ns() {
+            return stopped_once ? previous_ns : current_ns();
         }
+        size_t total() { return total_ns() / 1000; }
 
         void reset() {
-            previous_intervals = 0;
+            previous_ns = 0;
             stopped_once = false;
             start();
         }
 
-        void deadline(microseconds timeout) {
-            long long summ_of_microseconds = ((long long) start_time.tv_usec) + timeout;
-            lldiv_t res = lldiv(summ_of_microseconds, 1000000);
-            deadline_.tv_usec = res.rem;
-            deadline_.tv_sec = start_time.tv_sec + res.quot;
-        }
+        void deadline(microseconds timeout) { deadline_ns = ((uint64_t) (size_t) timeout) * 1000; }
 
-        bool deadline() {
-            struct timeval now;
-            gettimeofday(&now, NULL);
-            return now.tv_sec > deadline_.tv_sec ||
-                (now.tv_sec == deadline_.tv_sec && now.tv_usec >= deadline_.tv_usec);
-        }
+        bool deadline() { return current_ns() >= deadline_ns; }
 
         deadline_ostream deadline_description() { return deadline_ostream(this); }
 
@@ -74,9 +64,9 @@ namespace eger {
 
         private:
         friend std::ostream &operator<<(std::ostream &s, deadline_ostream t);
-        struct timeval start_time;
-        struct timeval deadline_;
-        size_t previous_intervals;
+        uint64_t start_ticks;
+        uint64_t deadline_ns;
+        uint64_t previous_ns;
         bool stopped_once;
     };
 
@@ -86,9 +76,7 @@ namespace eger {
     }
 
     inline std::ostream &operator<<(std::ostream &s, deadline_ostream t) {
-        s << t.tmr->current() << "ms >= ";
-        size_t diff = (((size_t) t.tmr->deadline_.tv_sec) * 1000000) + t.tmr->deadline_.tv_usec - (((size_t) t.tmr->start_time.tv_sec) * 1000000) - t.tmr->start_time.tv_usec;
-        s << diff << "ms";
+        s << t.tmr->current() << "ms >= " << t.tmr->deadline_ns / 1000 << "ms";
         return s;
     }
 
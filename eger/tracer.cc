@@ -0,0 +1,141 @@
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <mutex>
+#include <deque>
+#include <fstream>
+#include <algorithm>
+#include <iomanip>
+#include "tracer.h"
+
+namespace eger {
+
+namespace {
+
+// rings of exited threads are kept for snapshots, oldest are freed above this
+const size_t maximum_exited_rings = 64;
+
+struct rings {
+    std::mutex lock;
+    std::deque<trace_ring*> all;
+    size_t exited;
+};
+
+rings &trace_rings() {
+    static rings r;
+    return r;
+}
+
+void json_string(std::ostream &os, const char *s) {
+    os << '"';
+    for(; *s; ++s) {
+        if(*s == '"' || *s == '\\') os << '\\';
+        os << *s;
+    }
+    os << '"';
+}
+
+}
+
+trace_ring::trace_ring(size_t size) :
+    tid(syscall(SYS_gettid)),
+    exited(false),
+    head(0)
+{
+    size_t s = 1;
+    while(s < size) s <<= 1;
+    slots = new slot[s];
+    mask = s - 1;
+}
+
+trace_ring::~trace_ring() { delete[] slots; }
+
+// copies slots first and checks head afterwards, slots the owner could have
+// started to overwrite meanwhile are thrown away
+void trace_ring::snapshot(std::vector<event> &out) const {
+    uint64_t h = head.load(std::memory_order_acquire);
+    uint64_t from = h > mask ? h - mask - 1 : 0;
+    size_t at = out.size();
+    for(uint64_t i = from; i < h; ++i) {
+        const slot &s = slots[i & mask];
+        event e;
+        e.name = s.name.load(std::memory_order_relaxed);
+        e.ticks = s.ticks.load(std::memory_order_relaxed);
+        e.phase = s.phase.load(std::memory_order_relaxed);
+        out.push_back(e);
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t now = head.load(std::memory_order_relaxed);
+    // slot of event i is reused by event i + mask + 1
+    if(now >= from + mask + 1) {
+        size_t lost = std::min<uint64_t>(now - mask - from, h - from);
+        out.erase(out.begin() + at, out.begin() + at + lost);
+    }
+}
+
+trace_ring &create_trace_ring() {
+    trace_ring *ring = new trace_ring(instance::get_instance().trace_ring_size);
+    rings &r = trace_rings();
+    std::lock_guard<std::mutex> guard(r.lock);
+    r.all.push_back(ring);
+    return *ring;
+}
+
+trace_ring_holder::~trace_ring_holder() {
+    if(!ring) return;
+    rings &r = trace_rings();
+    std::lock_guard<std::mutex> guard(r.lock);
+    ring->exited = true;
+    if(++r.exited <= maximum_exited_rings) return;
+    for(std::deque<trace_ring*>::iterator it = r.all.begin(); it != r.all.end(); ++it)
+        if((*it)->exited) {
+            delete *it;
+            r.all.erase(it);
+            --r.exited;
+            break;
+        }
+}
+
+string trace_json() {
+    std::vector<std::vector<trace_ring::event> > events;
+    std::vector<long> tids;
+    {
+        rings &r = trace_rings();
+        std::lock_guard<std::mutex> guard(r.lock);
+        events.resize(r.all.size());
+        for(size_t i = 0; i < r.all.size(); ++i) {
+            r.all[i]->snapshot(events[i]);
+            tids.push_back(r.all[i]->tid);
+        }
+    }
+    // timestamps are microseconds since the earliest event
+    uint64_t base = 0;
+    for(size_t i = 0; i < events.size(); ++i)
+        if(!events[i].empty() && (!base || events[i].front().ticks < base)) base = events[i].front().ticks;
+    std::ostringstream os;
+    os << "{\"traceEvents\":[";
+    bool first = true;
+    pid_t pid = getpid();
+    for(size_t i = 0; i < events.size(); ++i)
+        for(size_t j = 0; j < events[i].size(); ++j) {
+            const trace_ring::event &e = events[i][j];
+            uint64_t ns = tick_clock::to_ns(e.ticks - base);
+            os << (first ? "\n" : ",\n") << "{\"name\":";
+            json_string(os, e.name);
+            os << ",\"ph\":\"" << e.phase << "\",\"ts\":" << ns / 1000 << '.' <<
+                std::setw(3) << std::setfill('0') << ns % 1000 << std::setfill(' ') <<
+                ",\"pid\":" << pid << ",\"tid\":" << tids[i];
+            if(e.phase == 'i') os << ",\"s\":\"t\"";
+            os << '}';
+            first = false;
+        }
+    os << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return os.str();
+}
+
+bool trace_write(const char *file_name) {
+    std::ofstream out(file_name);
+    out << trace_json();
+    return (bool) out.flush();
+}
+
+}
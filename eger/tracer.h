@@ -0,0 +1,88 @@
+#ifndef EGER_TRACER_H
+#define EGER_TRACER_H
+
+#include <atomic>
+#include <eger/clock.h>
+#include <eger/logger.h>
+
+namespace eger {
+
+// fixed size ring of trace events of one thread, only the owner writes,
+// snapshots are taken by other threads without stopping it
+class trace_ring {
+    public:
+    struct event {
+        const char *name;
+        uint64_t ticks;
+        char phase;
+    };
+
+    trace_ring(size_t size);
+    ~trace_ring();
+
+    void put(const char *name, char phase) {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        slot &s = slots[h & mask];
+        s.name.store(name, std::memory_order_relaxed);
+        s.ticks.store(tick_clock::ticks(), std::memory_order_relaxed);
+        s.phase.store(phase, std::memory_order_relaxed);
+        head.store(h + 1, std::memory_order_release);
+        // the new head is seen before the next event overwrites a slot
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    // appends events still in the ring, oldest first
+    void snapshot(std::vector<event> &out) const;
+
+    long tid;
+    bool exited;
+
+    private:
+    trace_ring(const trace_ring &);
+
+    struct slot {
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> ticks;
+        std::atomic<char> phase;
+    };
+
+    std::atomic<uint64_t> head;
+    slot *slots;
+    size_t mask;
+};
+
+trace_ring &create_trace_ring();
+
+struct trace_ring_holder {
+    trace_ring_holder() : ring(0) {}
+    ~trace_ring_holder();
+    trace_ring *ring;
+};
+
+inline trace_ring &local_trace_ring() {
+    static thread_local trace_ring_holder h;
+    if(!h.ring) h.ring = &create_trace_ring();
+    return *h.ring;
+}
+
+inline bool is_tracing() {
+    return instance::get_instance().tracing;
+}
+
+// events of all threads, exited ones included, as Chrome trace-event JSON
+// for chrome://tracing or ui.perfetto.dev
+string trace_json();
+bool trace_write(const char *file_name);
+
+#define span_begin(label) \
+    (eger::is_tracing() ? eger::local_trace_ring().put(#label, 'B'), 0 : 0)
+
+#define span_end(label) \
+    (eger::is_tracing() ? eger::local_trace_ring().put(#label, 'E'), 0 : 0)
+
+#define span_instant(label) \
+    (eger::is_tracing() ? eger::local_trace_ring().put(#label, 'i'), 0 : 0)
+
+}
+
+#endif
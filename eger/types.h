@@ -1,10 +1,14 @@
 #ifndef EGER_TYPES_H
 #define EGER_TYPES_H
 
+#include <string.h>
 #include <string>
 #include <vector>
 #include <sstream>
+#include <streambuf>
+#include <algorithm>
 #include <chrono>
+#include <eger/clock.h>
 
 namespace eger {
 
@@ -22,18 +26,158 @@ enum log_level {
         level_debug_mare
 };
 
-struct log_stream : public std::ostringstream {
+// severity rank of levels for the preprocessor, warning is more severe
+// than info although it comes after it in log_level
+#define EGER_LEVEL_CRITICAL     0
+#define EGER_LEVEL_ERROR        1
+#define EGER_LEVEL_WARNING      2
+#define EGER_LEVEL_INFO         3
+#define EGER_LEVEL_PROFILE      4
+#define EGER_LEVEL_DEBUG        5
+#define EGER_LEVEL_DEBUG_HARD   6
+#define EGER_LEVEL_DEBUG_MARE   7
+
+// levels less severe than EGER_MIN_LEVEL are compiled out with their arguments,
+// e.g. -DEGER_MIN_LEVEL=EGER_LEVEL_WARNING leaves no info, profile and debug call sites,
+// debug_hard and debug_mare are compiled out under NDEBUG by default
+#ifndef EGER_MIN_LEVEL
+#ifdef NDEBUG
+#define EGER_MIN_LEVEL EGER_LEVEL_DEBUG
+#else
+#define EGER_MIN_LEVEL EGER_LEVEL_DEBUG_MARE
+#endif
+#endif
+
+// 0 for the most severe level, the same numbers as EGER_LEVEL_*
+constexpr int severity_rank(log_level lvl) {
+    return lvl == level_info ? EGER_LEVEL_INFO : lvl == level_warning ? EGER_LEVEL_WARNING : (int) lvl;
+}
+
+constexpr bool is_compiled_level(log_level lvl) {
+    return severity_rank(lvl) <= EGER_MIN_LEVEL;
+}
+
+// streambuf writing into inline storage first and spilling to the heap,
+// spilled storage is kept on reset so reused records don't allocate
+class log_buffer : public std::streambuf {
+    public:
+    log_buffer() { reset(); }
+
+    void reset() { setp(inline_data, inline_data + inline_size); }
+
+    const char *data() const { return pbase(); }
+    char *data() { return pbase(); }
+    size_t size() const { return pptr() - pbase(); }
+    string str() const { return string(data(), size()); }
+
+    protected:
+    int_type overflow(int_type c) {
+        if(traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        grow(size() + 1);
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        return c;
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) {
+        if(epptr() - pptr() < n) grow(size() + n);
+        memcpy(pptr(), s, n);
+        pbump(n);
+        return n;
+    }
+
+    private:
+    void grow(size_t need) {
+        size_t used = size();
+        size_t capacity = std::max(need, (size_t) (epptr() - pbase()) * 2);
+        if(pbase() == inline_data) {
+            if(spill.size() < capacity) spill.resize(capacity);
+            memcpy(&spill[0], inline_data, used);
+        } else
+            spill.resize(capacity);
+        setp(&spill[0], &spill[0] + spill.size());
+        pbump(used);
+    }
+
+    static const size_t inline_size = 256;
+    char inline_data[inline_size];
+    string spill;
+};
+
+class log_stream_pool;
+struct format_descriptor;
+struct level_route;
+
+struct log_stream_storage {
+    log_buffer buffer;
+};
+
+struct log_stream : private log_stream_storage, public std::ostream {
     log_stream(log_level _lvl) :
+        std::ostream(&buffer),
         lvl(_lvl),
-        moment(std::chrono::system_clock::now()),
-        multiline(false)
+        moment(fast_clock::now()),
+        multiline(false),
+        format(0),
+        route(0),
+        pool(0),
+        next(0)
     {}
+
+    string str() const { return buffer.str(); }
+    const char *data() const { return buffer.data(); }
+    char *data() { return buffer.data(); }
+    size_t size() const { return buffer.size(); }
+    void append(const void *p, size_t n) { buffer.sputn((const char*) p, n); }
+
+    // prepare pooled record for the next use
+    void reuse(log_level _lvl) {
+        buffer.reset();
+        clear();
+        flags(std::ios_base::dec | std::ios_base::skipws);
+        width(0);
+        precision(6);
+        fill(' ');
+        lvl = _lvl;
+        moment = fast_clock::now();
+        multiline = false;
+        format = 0;
+    }
+
     log_level lvl;
     std::chrono::system_clock::time_point moment;
     bool multiline;
+    const format_descriptor *format;     // set for deferred records, data() holds arguments then
+    level_route *route;                  // set when passed to writer
+    log_stream_pool *pool;
+    log_stream *next;
 };
 
 const size_t log_level_size = ((size_t) level_debug_mare) + 1;
+const size_t maximum_writer_shards = 16;
+
+// what happens to a record which doesn't fit into a full queue
+enum overflow_policy {
+        overflow_drop_newest = 0,           // record is dropped
+        overflow_block,                     // producer waits for a bounded time, then drops
+        overflow_overwrite_oldest,          // oldest queued record is dropped instead unless
+                                            //     it is more severe, then the record is dropped
+        overflow_drop_lower_severity        // less severe levels may use less of the queue
+};
+
+inline const char *level_name(log_level l) {
+    switch(l) {
+        case level_critical:   return "critical";
+        case level_error:      return "error";
+        case level_info:       return "info";
+        case level_warning:    return "warning";
+        case level_profile:    return "profile";
+        case level_debug:      return "debug";
+        case level_debug_hard: return "debug_hard";
+        case level_debug_mare: return "debug_mare";
+    }
+    return "unknown";
+}
 
 inline log_level str_to_error_level(const string &s) {
     if(s.empty()) return level_critical;
@@ -2,95 +2,359 @@
 #include <iomanip>
 #include <ratio>
 #include <unistd.h>
+#include <poll.h>
 #include "writer.h"
+#include "deferred.h"
+#include "profiler.h"
+#include "recorder.h"
 
 namespace eger {
 
-writer::writer(instance *_inst, size_t queue_size) :
+namespace {
+
+std::atomic<uint64_t> last_generation(0);
+std::atomic<uint64_t> live_generation[maximum_writer_shards];
+// held by an exiting thread abandoning its queues and by a writer going
+// away, so a queue is never touched after its writer has deleted it
+std::mutex queues_lock;
+
+struct thread_queue {
+    thread_queue() : generation(0), queue(0) {}
+    uint64_t generation;
+    writer::producer_queue *queue;
+};
+
+// a queue per shard the thread has written to
+struct thread_queues {
+    ~thread_queues() {
+        std::lock_guard<std::mutex> guard(queues_lock);
+        for(size_t i = 0; i < maximum_writer_shards; ++i)
+            if(shards[i].queue && live_generation[i].load(std::memory_order_acquire) == shards[i].generation)
+                shards[i].queue->abandoned.store(true, std::memory_order_release);
+    }
+    thread_queue shards[maximum_writer_shards];
+};
+
+thread_local thread_queues local;
+
+// with overflow_overwrite_oldest a queued record gives way only to one
+// at least as severe
+struct not_more_severe {
+    not_more_severe(log_level lvl) : rank(severity_rank(lvl)) {}
+    bool operator()(const log_stream *ls) const { return severity_rank(ls->lvl) >= rank; }
+    int rank;
+};
+
+}
+
+writer::writer(instance *_inst, size_t _queue_size, bool _per_thread, size_t _shard) :
     inst(_inst),
-    writing(0),
-    accepting(0),
+    queue(0),
     wait_for_finish(false),
-    finished(false),
-    sync_mode(false)
+    sync_mode(false),
+    per_thread(_per_thread),
+    shard(_shard),
+    queue_size(_queue_size),
+    generation(++last_generation),
+    high_water_mark(_inst->high_water_mark),
+    wake_pending(false),
+    archives(_inst->compress_archives, _inst->maximum_log_archives, _inst->maximum_archives_size)
 {
+    for(size_t i = 0; i < log_level_size; ++i) dropped[i] = 0;
     assert(queue_size > 0);
     queue_size = next_nearest_power_of_2(queue_size);
-    queue = new log_stream*[queue_size];
-    queue_mask = queue_size - 1;
-    memset(queue, 0, queue_size * sizeof(log_stream*));
+    if(!high_water_mark || high_water_mark > queue_size) high_water_mark = queue_size / 2;
+    if(pipe(wake_pipe) == 0) {
+        fcntl(wake_pipe[0], F_SETFL, O_NONBLOCK);
+        fcntl(wake_pipe[1], F_SETFL, O_NONBLOCK);
+    } else
+        wake_pipe[0] = wake_pipe[1] = -1;
+    live_generation[shard].store(generation, std::memory_order_release);
+    if(per_thread) return;
+    queue = new mpmc_ring<log_stream*>(queue_size);
 }
 
 writer::writer(instance *_inst) :
     inst(_inst),
     queue(0),
-    queue_mask(0),
-    writing(0),
-    accepting(0),
     wait_for_finish(false),
-    finished(false),
-    sync_mode(true)
-{}
+    sync_mode(true),
+    per_thread(false),
+    shard(0),
+    queue_size(0),
+    generation(0),
+    high_water_mark(0),
+    wake_pending(false),
+    archives(_inst->compress_archives, _inst->maximum_log_archives, _inst->maximum_archives_size)
+{
+    for(size_t i = 0; i < log_level_size; ++i) dropped[i] = 0;
+    wake_pipe[0] = wake_pipe[1] = -1;
+}
 
 
-writer::~writer() { delete[] queue; }
+writer::~writer() {
+    close_destinations();
+    if(wake_pipe[0] != -1) ::close(wake_pipe[0]);
+    if(wake_pipe[1] != -1) ::close(wake_pipe[1]);
+    if(generation) {
+        std::lock_guard<std::mutex> guard(queues_lock);
+        live_generation[shard].store(0, std::memory_order_release);
+    }
+    for(size_t i = 0; i < producers.size(); ++i)
+        delete producers[i];
+    delete queue;
+}
 
 void writer::static_run(writer *wrt) { wrt->run(); }
 
 void writer::push_back(log_stream *ls) {
+    producer_counters &pc = local_producer_counters();
+    producer_counters::add(pc.pushed);
     if(sync_mode) {
-        int fd = -1;
-        perform_writing(ls, fd);
-        if(fd >= 0) ::close(fd);
+        std::lock_guard<std::mutex> guard(sync_lock);
+        ++counters.cycles;
+        ++counters.records;
+        counters.largest_batch = 1;
+        perform_writing(ls);
+        flush_destinations();
         return;
     }
-    size_t my_place = __sync_fetch_and_add(&accepting, 1);
-    my_place &= queue_mask;
-    if(queue[my_place]) {
+    log_level lvl = ls->lvl;
+    overflow_policy policy = inst->overflow[(size_t) lvl];
+    size_t depth = per_thread ? push_to_thread_queue(ls, policy) : push_to_queue(ls, policy);
+    pc.seen_depth(depth);
+    if(lvl == level_critical || depth >= high_water_mark) wake();
+}
+
+// share of the queue a level may fill with overflow_drop_lower_severity,
+// critical may use all of it, every less severe level an eighth less
+inline bool writer::admitted(log_level lvl, size_t depth) {
+    return depth < (queue_size >> 3) * (log_level_size - severity_rank(lvl));
+}
+
+void writer::drop(log_stream *ls) {
+    dropped[(size_t) ls->lvl].fetch_add(1, std::memory_order_relaxed);
+    producer_counters::add(local_producer_counters().dropped);
+    log_stream_pool::release(ls);
+}
+
+size_t writer::push_to_thread_queue(log_stream *ls, overflow_policy policy) {
+    producer_queue *pq = local_queue();
+    spsc_ring<log_stream*> &ring = pq->ring;
+    if(policy == overflow_drop_lower_severity && !admitted(ls->lvl, ring.depth())) {
+        drop(ls);
+        return ring.depth();
+    }
+    if(ring.push(ls)) return ring.depth();
+    switch(policy) {
+        case overflow_block: {
+            producer_counters::add(local_producer_counters().blocked);
+            wake();
+            std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + inst->overflow_block_timeout;
+            do {
+                std::this_thread::yield();
+                if(ring.push(ls)) return ring.depth();
+            } while(std::chrono::steady_clock::now() < until);
+            drop(ls);
+            break;
+        }
+        case overflow_overwrite_oldest: {
+            log_stream *oldest;
+            while(!ring.push(ls)) {
+                oldest = 0;
+                if(ring.steal_if(oldest, not_more_severe(ls->lvl))) drop(oldest);
+                else if(oldest) {
+                    drop(ls);
+                    break;
+                }
+            }
+            break;
+        }
+        default:
+            drop(ls);
+    }
+    return ring.depth();
+}
+
+size_t writer::push_to_queue(log_stream *ls, overflow_policy policy) {
+    if(policy == overflow_drop_lower_severity && !admitted(ls->lvl, queue->depth())) {
+        drop(ls);
+        return queue->depth();
+    }
+    if(queue->push(ls)) return queue->depth();
+    switch(policy) {
+        case overflow_block: {
+            producer_counters::add(local_producer_counters().blocked);
+            wake();
+            std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + inst->overflow_block_timeout;
+            do {
+                std::this_thread::yield();
+                if(queue->push(ls)) return queue->depth();
+            } while(std::chrono::steady_clock::now() < until);
+            drop(ls);
+            break;
+        }
+        case overflow_overwrite_oldest: {
+            // records of other threads are in the queue, a more severe
+            // oldest one is kept and ls dropped instead
+            log_stream *oldest;
+            while(!queue->push(ls)) {
+                oldest = 0;
+                if(queue->pop_if(oldest, not_more_severe(ls->lvl))) drop(oldest);
+                else if(oldest) {
+                    drop(ls);
+                    break;
+                }
+            }
+            break;
+        }
+        default:
+            drop(ls);
+    }
+    return queue->depth();
+}
+
+void writer::report_dropped(bool now) {
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+    if(!now && t - last_drop_report < std::chrono::seconds(1)) return;
+    last_drop_report = t;
+    for(size_t i = 0; i < log_level_size; ++i) {
+        size_t n = dropped[i].exchange(0, std::memory_order_relaxed);
+        if(!n) continue;
         log_stream els(level_warning);
-        els << "log queue full, dropping record";
+        els << "log queue full, dropped " << n << " records at level " << level_name((log_level) i);
         std::cerr << compose_log_string(&els, inst->ansi_colors);
-        delete ls;
-    } else {
-        queue[my_place] = ls;
     }
 }
 
+void writer::wake() {
+    if(wake_pending.load(std::memory_order_relaxed) || wake_pending.exchange(true)) return;
+    char c = 0;
+    if(write(wake_pipe[1], &c, 1) < 0) {}
+}
+
 void writer::stop() {
     wait_for_finish = true;
-    while(!sync_mode && !finished)
-        usleep(100000);
+    if(!sync_mode) wake();
+}
+
+namespace {
+
+// "HH:MM:SS" of the last rendered second
+struct second_cache {
+    second_cache() : second(-1) {}
+    time_t second;
+    char text[8];
+};
+
+thread_local second_cache last_second;
+
+// "YYYY-MM-DDTHH:MM:SS" in UTC of the last structured record
+struct utc_second_cache {
+    utc_second_cache() : second(-1) {}
+    time_t second;
+    char text[20];
+};
+
+thread_local utc_second_cache last_utc_second;
+
+inline void put_2_digits(char *p, int v) {
+    p[0] = '0' + v / 10;
+    p[1] = '0' + v % 10;
+}
+
 }
 
 string writer::compose_log_string(log_stream *ls, bool ansi_colors) {
+    string d;
+    compose_log_string(ls, ansi_colors, d);
+    return d;
+}
+
+void writer::compose_log_string(log_stream *ls, bool ansi_colors, string &d) {
+    using namespace std::chrono;
+    int64_t ms = duration_cast<milliseconds>(ls->moment.time_since_epoch()).count();
+    time_t tt = ms / 1000;
+    if(tt != last_second.second) {
+        tm local_tm;
+        ::localtime_r(&tt, &local_tm);
+        put_2_digits(last_second.text, local_tm.tm_hour);
+        last_second.text[2] = ':';
+        put_2_digits(last_second.text + 3, local_tm.tm_min);
+        last_second.text[5] = ':';
+        put_2_digits(last_second.text + 6, local_tm.tm_sec);
+        last_second.second = tt;
+    }
+    string rendered;
+    if(ls->format) render_deferred(ls, rendered);
+    const char *body = ls->format ? rendered.data() : ls->data();
+    size_t body_size = ls->format ? rendered.size() : ls->size();
+
+    d.reserve(d.size() + body_size + 48);
+    if(ansi_colors) d += "\x1b[38;5;238m";
+    char stamp[13];
+    memcpy(stamp, last_second.text, 8);
+    int msec = ms % 1000;
+    stamp[8] = '.';
+    stamp[9] = '0' + msec / 100;
+    put_2_digits(stamp + 10, msec % 100);
+    stamp[12] = ' ';
+    d.append(stamp, sizeof(stamp));
+    d += level_to_string(ls->lvl, ansi_colors);
+    d += ' ';
+    if(ansi_colors) d += "\x1b[m";
+    size_t at = d.size();
+    d.append(body, body_size);
+    if(!ls->multiline)
+        for(string::iterator i = d.begin() + at; i != d.end(); ++i)
+            if((uint8_t) *i < ' ') *i = ' ';
+    d += '\n';
+}
+
+void writer::compose_structured_string(log_stream *ls, layout format, string &d) {
     using namespace std::chrono;
-    using namespace std;
-    ostringstream d;
-
-    time_t tt = system_clock::to_time_t(ls->moment);
-    tm local_tm;
-    ::localtime_r(&tt, &local_tm);
-    system_clock::duration tp = ls->moment.time_since_epoch();
-    milliseconds ms = duration_cast<milliseconds>(tp);
-    if(ansi_colors) d << char(27) << "[38;5;238m";
-    /* no date
-    d << (now_t.tm_year + 1900) << '.' << setw(2) << setfill('0') << (now_t.tm_mon + 1) << '.' <<
-        setw(2) << setfill('0') << now_t.tm_mday;
-    d << ' ';
-    */
-    d << setw(2) << setfill('0') << local_tm.tm_hour << ':' <<
-        setw(2) << setfill('0') << local_tm.tm_min << ':' <<
-        setw(2) << setfill('0') << local_tm.tm_sec;
-    d << '.' << setw(3) << setfill('0') << (ms.count() % 1000);
-    d << ' ';
-    d << level_to_string(ls->lvl, ansi_colors);
-    d << ' ';
-    if(ansi_colors) d << char(27) << "[m";
-    string ls_str(ls->str());
-    transform(ls_str.begin(), ls_str.end(), ostream_iterator<uint8_t>(d),
-            [=](const uint8_t c) -> uint8_t { if(!ls->multiline && c < ' ') return ' '; else return c; });
-    d << '\n';
-    return d.str();
+    int64_t ms = duration_cast<milliseconds>(ls->moment.time_since_epoch()).count();
+    time_t tt = ms / 1000;
+    if(tt != last_utc_second.second) {
+        tm utc_tm;
+        ::gmtime_r(&tt, &utc_tm);
+        strftime(last_utc_second.text, sizeof(last_utc_second.text), "%Y-%m-%dT%H:%M:%S", &utc_tm);
+        last_utc_second.second = tt;
+    }
+    char stamp[25];
+    memcpy(stamp, last_utc_second.text, 19);
+    int msec = ms % 1000;
+    stamp[19] = '.';
+    stamp[20] = '0' + msec / 100;
+    put_2_digits(stamp + 21, msec % 100);
+    stamp[23] = 'Z';
+    stamp[24] = 0;
+    string message;
+    if(ls->format) render_deferred(ls, message, false);
+    const char *body = ls->format ? message.data() : ls->data();
+    size_t body_size = ls->format ? message.size() : ls->size();
+    const char *level = level_name(ls->lvl);
+
+    d.reserve(d.size() + body_size + 64);
+    if(format == layout_json) {
+        d += "{\"ts\":\"";
+        d += stamp;
+        d += "\",\"level\":\"";
+        d += level;
+        d += "\",\"msg\":";
+        json_string(body, body_size, d);
+        if(ls->format) render_json_fields(ls, d);
+        d += "}\n";
+    } else {
+        d += "ts=";
+        d += stamp;
+        d += " level=";
+        d += level;
+        d += " msg=";
+        logfmt_string(body, body_size, d);
+        if(ls->format) render_logfmt_fields(ls, d);
+        d += '\n';
+    }
 }
 
 const char *writer::level_to_string(log_level l, bool ansi_colors) {
@@ -107,102 +371,341 @@ const char *writer::level_to_string(log_level l, bool ansi_colors) {
     return "unknown";
 }
 
-void writer::perform_writing(log_stream *ls, int &fd) {
-    string &file_name = (*inst)[(size_t) ls->lvl];
-    bool print_to_file = file_name != "stdout" && file_name != "stderr";
-    if(print_to_file && fd == -1)
-        if(!try_open_file(file_name, fd)) {
-            std::cerr << compose_log_string(ls, inst->ansi_colors);
-            delete ls;
-            return;
+writer::destination *writer::find_destination(const string &name) {
+    std::map<string, destination>::iterator it = destinations.find(name);
+    if(it != destinations.end()) return &it->second;
+    destination &d = destinations[name];
+    // layout prefixes may stand before or after the scheme
+    string target;
+    size_t from = 0, colon;
+    while((colon = name.find(':', from)) != string::npos) {
+        string prefix = name.substr(from, colon - from);
+        if(prefix == "binary") d.format = layout_binary;
+        else if(prefix == "json") d.format = layout_json;
+        else if(prefix == "logfmt") d.format = layout_logfmt;
+        else target.append(name, from, colon - from + 1);
+        from = colon + 1;
+    }
+    target.append(name, from, string::npos);
+    sink_context c = { inst, &archives, d.format == layout_binary };
+    d.output = create_sink(target, c);
+    return &d;
+}
+
+void writer::perform_writing(log_stream *ls) {
+    level_route *r = ls->route;
+    // only this writer gets records of the route
+    if(!r->resolved) r->resolved = find_destination(r->destination);
+    destination *d = r->resolved;
+    if(!(inst->dedup_window.count() && repeated(ls, *d))) write_record(ls, *d);
+    log_stream_pool::release(ls);
+}
+
+namespace {
+
+// FNV-1a of level, format and body, records of the same hash render the same,
+// literal arguments of deferred ones are pointers to the same text
+uint64_t record_hash(const log_stream *ls) {
+    uint64_t h = 14695981039346656037ULL;
+    h = (h ^ (uint64_t) ls->lvl) * 1099511628211ULL;
+    h = (h ^ (uint64_t) (uintptr_t) ls->format) * 1099511628211ULL;
+    const char *p = ls->data();
+    for(const char *e = p + ls->size(); p != e; ++p)
+        h = (h ^ (uint8_t) *p) * 1099511628211ULL;
+    return h;
+}
+
+}
+
+// a record like the last one of d within dedup_window is only counted, the
+// count is written before a different record or when the window closes
+bool writer::repeated(log_stream *ls, destination &d) {
+    uint64_t h = record_hash(ls);
+    if(h == d.last_hash && ls->moment - d.window_start < inst->dedup_window) {
+        ++d.repeats;
+        ++d.stats.suppressed;
+        return true;
+    }
+    write_repeats(d);
+    d.last_hash = h;
+    d.last_level = ls->lvl;
+    d.window_start = ls->moment;
+    return false;
+}
+
+void writer::write_repeats(destination &d) {
+    if(!d.repeats) return;
+    log_stream ls(d.last_level);
+    ls << "last message repeated " << d.repeats << " times";
+    d.repeats = 0;
+    write_record(&ls, d);
+}
+
+void writer::write_record(log_stream *ls, destination &d) {
+    bool started;
+    if(!d.output->open(started)) {
+        ++d.stats.failures;
+        std::cerr << compose_log_string(ls, inst->ansi_colors);
+        return;
+    }
+    // descriptors are repeated in every new file, rotated ones included
+    if(started && d.format == layout_binary) {
+        d.buffer.append(binary_magic, sizeof(binary_magic));
+        d.ids.clear();
+    }
+    uint64_t start = tick_clock::ticks();
+    switch(d.format) {
+        case layout_text: compose_log_string(ls, inst->ansi_colors, d.buffer); break;
+        case layout_binary: perform_binary_writing(ls, d); break;
+        case layout_json:
+        case layout_logfmt: compose_structured_string(ls, d.format, d.buffer); break;
+    }
+    counters.format_ns += tick_clock::to_ns(tick_clock::ticks() - start);
+    d.ends.push_back(d.buffer.size());
+    sink *out = d.output;
+    if(out->immediate()) flush_destination(d);
+    if(out->rotatable() && out->size() + d.buffer.size() > inst->maximum_log_size) {
+        flush_destination(d);
+        if(out->rotate()) ++d.stats.rotations;
+    } else if(d.buffer.size() >= 1024*1024)
+        flush_destination(d);
+}
+
+void writer::perform_binary_writing(log_stream *ls, destination &d) {
+    uint32_t id = 0;
+    if(ls->format) {
+        std::map<const format_descriptor*, uint32_t>::iterator it = d.ids.find(ls->format);
+        if(it != d.ids.end()) id = it->second;
+        else {
+            id = d.ids.size() + 1;
+            d.ids[ls->format] = id;
+            binary_descriptor(d.buffer, id, ls->format);
         }
-    string log_string = compose_log_string(ls, inst->ansi_colors);
-    int rfd = print_to_file ? fd : file_name[5] == 't' ? 1 : 2;
-    write(rfd, log_string.data(), log_string.size());
-    delete ls;
+    }
+    binary_record(d.buffer, id, ls);
 }
 
-void writer::write_logs() {
-    std::vector<int> fds;
-    for(size_t i = 0; i < log_level_size; ++i)
-        fds.push_back(-1);
-    size_t lost_record = size_t(0) - 1;
-    for(; writing < accepting;
-            __sync_synchronize(), ++writing) {
-        size_t offset = writing & queue_mask;
-        log_stream *ls = __sync_fetch_and_and(queue + offset, 0);
-        if(!ls) {
-            if(lost_record == size_t(0) - 1) lost_record = writing;
-            continue;
+void writer::flush_destination(destination &d) {
+    if(d.buffer.empty()) return;
+    uint64_t start = tick_clock::ticks();
+    d.output->write(sink_batch(d.buffer, d.ends));
+    uint64_t ns = tick_clock::to_ns(tick_clock::ticks() - start);
+    counters.write_ns += ns;
+    counters.longest_write_ns = std::max(counters.longest_write_ns, ns);
+    d.stats.records += d.ends.size();
+    d.stats.bytes += d.buffer.size();
+    ++d.stats.writes;
+    d.buffer.clear();
+    d.ends.clear();
+}
+
+void writer::flush_destinations() {
+    for(std::map<string, destination>::iterator it = destinations.begin(); it != destinations.end(); ++it) {
+        destination &d = it->second;
+        if(d.repeats && fast_clock::now() - d.window_start >= inst->dedup_window) write_repeats(d);
+        flush_destination(d);
+        d.output->flush();
+        if(d.output->rotatable() && d.output->size() > inst->maximum_log_size) {
+            if(d.output->rotate()) ++d.stats.rotations;
         }
-        perform_writing(ls, fds[(size_t) ls->lvl]);
-    }
-    if(lost_record != size_t(0) - 1)
-        writing = lost_record;
-    for(size_t i = 0; i < log_level_size; ++i)
-        if(fds[i] != -1) close(fds[i]);
-}
-
-bool writer::try_open_file(const string &fn, int &fd) {
-    check_size_and_rename(fn);
-    fd = open(fn.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0660);
-    if(fd < 0) {
-        log_stream ls(level_warning);
-        char str_buf[256];
-        strerror_r(errno, str_buf, 256);
-        ls << "can't open file \"" << fn << "\" for writing: " << str_buf;
-        std::cerr << compose_log_string(&ls, inst->ansi_colors);
-        return false;
-    }
-    return true;
-}
-
-void writer::check_size_and_rename(const string &fn) {
-    struct stat fn_stat;
-    if(stat(fn.c_str(), &fn_stat) < 0) return;
-    if((size_t) fn_stat.st_size > inst->maximum_log_size)
-        rename_log(fn, fn + ".0");
-}
-
-void writer::rename_log(const string &from, const string &to) {
-    if(access(to.c_str(), F_OK) == 0) {
-        // exists
-        string::size_type ind = to.rfind('.');
-        if(ind != string::npos) {
-            ++ind;
-            long ind_n = atol(to.c_str() + ind);
-            std::ostringstream next_to;
-            next_to << to.substr(0, ind);
-            next_to << (ind_n + 1);
-            rename_log(to, next_to.str());
+    }
+}
+
+void writer::close_destinations() {
+    for(std::map<string, destination>::iterator it = destinations.begin(); it != destinations.end(); ++it) {
+        destination &d = it->second;
+        write_repeats(d);
+        flush_destination(d);
+        d.output->close();
+        delete d.output;
+        d.output = 0;
+    }
+    destinations.clear();
+}
+
+void writer::write_logs() {
+    log_stream *ls;
+    size_t n = 0;
+    for(; n < queue->capacity() && queue->pop(ls); ++n)
+        perform_writing(ls);
+    flush_destinations();
+    if(!n) return;
+    ++counters.cycles;
+    counters.records += n;
+    counters.largest_batch = std::max(counters.largest_batch, n);
+    publish_stats();
+}
+
+writer::producer_queue *writer::local_queue() {
+    thread_queue &local_shard = local.shards[shard];
+    if(local_shard.generation == generation) return local_shard.queue;
+    producer_queue *pq = new producer_queue(queue_size);
+    {
+        std::lock_guard<std::mutex> guard(producers_lock);
+        producers.push_back(pq);
+    }
+    local_shard.generation = generation;
+    local_shard.queue = pq;
+    return pq;
+}
+
+void writer::write_thread_logs() {
+    std::vector<producer_queue*> current;
+    {
+        std::lock_guard<std::mutex> guard(producers_lock);
+        current = producers;
+    }
+    batch.clear();
+    runs.clear();
+    std::vector<producer_queue*> gone;
+    for(size_t i = 0; i < current.size(); ++i) {
+        producer_queue *pq = current[i];
+        // abandoned is checked before draining so nothing pushed before thread exit is missed
+        bool abandoned = pq->abandoned.load(std::memory_order_acquire);
+        log_stream *ls;
+        batch_run r = { batch.size(), 0 };
+        while(pq->ring.pop(ls)) batch.push_back(ls);
+        r.end = batch.size();
+        if(r.next != r.end) runs.push_back(r);
+        if(abandoned) gone.push_back(pq);
+    }
+    if(!gone.empty()) {
+        std::lock_guard<std::mutex> guard(producers_lock);
+        for(size_t i = 0; i < gone.size(); ++i) {
+            producers.erase(std::find(producers.begin(), producers.end(), gone[i]));
+            delete gone[i];
         }
     }
-    if(rename(from.c_str(), to.c_str()) < 0) {
-        log_stream ls(level_warning);
-        char str_buf[256];
-        strerror_r(errno, str_buf, 256);
-        ls << "can't rename file \"" << from << "\" to \"" << to << "\": " << str_buf;
-        std::cerr << compose_log_string(&ls, inst->ansi_colors);
+    if(batch.empty()) return;
+    // rings are merged by the moment of their heads, every ring is taken in its
+    // own order as moments of a thread may step back when fast_clock is
+    // re-anchored, ties go to the ring drained first
+    std::vector<log_stream*> &b = batch;
+    auto later = [&b] (const batch_run &x, const batch_run &y) {
+        return b[y.next]->moment < b[x.next]->moment ||
+            (b[y.next]->moment == b[x.next]->moment && y.next < x.next);
+    };
+    std::make_heap(runs.begin(), runs.end(), later);
+    while(!runs.empty()) {
+        std::pop_heap(runs.begin(), runs.end(), later);
+        batch_run &r = runs.back();
+        perform_writing(batch[r.next]);
+        if(++r.next == r.end) runs.pop_back();
+        else std::push_heap(runs.begin(), runs.end(), later);
     }
+    ++counters.cycles;
+    counters.records += batch.size();
+    counters.largest_batch = std::max(counters.largest_batch, batch.size());
+    batch.clear();
+    flush_destinations();
+    publish_stats();
+}
+
+bool writer::has_pending() {
+    if(!per_thread) return queue->depth() > 0;
+    std::lock_guard<std::mutex> guard(producers_lock);
+    for(size_t i = 0; i < producers.size(); ++i)
+        if(producers[i]->ring.depth()) return true;
+    return false;
+}
+
+void writer::dump_profiles() {
+    if(!instance::is_using_this_level(level_profile)) return;
+    string table = profiler_table();
+    if(table.empty()) return;
+    log_stream *ls = log_stream_pool::acquire(level_profile);
+    ls->multiline = true;
+    *ls << table;
+    inst->pass_to_writer(ls);
+}
+
+void writer::dump_stats() {
+    if(!instance::is_using_this_level(level_profile)) return;
+    log_stream *ls = log_stream_pool::acquire(level_profile);
+    *ls << stats_summary(inst->stats());
+    inst->pass_to_writer(ls);
+}
+
+void writer::collect_stats(writer_stats &s) {
+    std::vector<destination_stats> ds;
+    ds.swap(s.destinations);
+    s = counters;
+    ds.clear();
+    for(std::map<string, destination>::iterator it = destinations.begin(); it != destinations.end(); ++it) {
+        ds.push_back(it->second.stats);
+        ds.back().name = it->first;
+        ds.back().syscalls = it->second.output->syscalls;
+    }
+    s.destinations.swap(ds);
+}
+
+void writer::publish_stats() {
+    std::lock_guard<std::mutex> guard(stats_lock);
+    collect_stats(published);
+}
+
+// counters as of the last cycle with records, queue depth as of now
+writer_stats writer::stats() {
+    writer_stats s;
+    if(sync_mode) {
+        std::lock_guard<std::mutex> guard(sync_lock);
+        collect_stats(s);
+        return s;
+    }
+    {
+        std::lock_guard<std::mutex> guard(stats_lock);
+        s = published;
+    }
+    s.queue_capacity = queue_size;
+    if(!per_thread) s.queue_depth = queue->depth();
+    else {
+        std::lock_guard<std::mutex> guard(producers_lock);
+        for(size_t i = 0; i < producers.size(); ++i) s.queue_depth += producers[i]->ring.depth();
+    }
+    return s;
 }
 
 void writer::run() {
     using namespace std::chrono;
+    steady_clock::time_point next_dump_time = steady_clock::now() + inst->profiler_dump_interval;
+    steady_clock::time_point next_stats_time = steady_clock::now() + inst->stats_interval;
     while(true) {
-        system_clock::time_point start_time = system_clock::now();
-        __sync_synchronize();
-        if(writing < accepting) write_logs();
-        __sync_synchronize();
-        if(wait_for_finish && writing == accepting) {
-            finished = true;
+        steady_clock::time_point now = steady_clock::now();
+        steady_clock::time_point next_cycle_time = now + inst->flush_interval;
+        if(!shard && flight_recorder_requested()) flight_recorder_dump();
+        if(inst->profiler_dump_interval.count() && !shard) {
+            if(now >= next_dump_time) {
+                dump_profiles();
+                next_dump_time = now + inst->profiler_dump_interval;
+            }
+            next_cycle_time = std::min(next_cycle_time, next_dump_time);
+        }
+        if(inst->stats_interval.count() && !shard) {
+            if(now >= next_stats_time) {
+                dump_stats();
+                next_stats_time = now + inst->stats_interval;
+            }
+            next_cycle_time = std::min(next_cycle_time, next_stats_time);
+        }
+        if(per_thread) write_thread_logs();
+        else write_logs();
+        if(wait_for_finish && !has_pending()) {
+            report_dropped(true);
             break;
         }
-        system_clock::time_point next_cycle_time = start_time + seconds(1);
-        system_clock::time_point now = system_clock::now();
-        if(next_cycle_time > now) {
-            auto drt(next_cycle_time - now);
-            if(wait_for_finish) usleep(duration_cast<microseconds>(drt).count() / 10);
-            else usleep(duration_cast<microseconds>(drt).count());
+        report_dropped(false);
+        // sleep till the next cycle unless producers ask for an early one
+        while(!wait_for_finish) {
+            steady_clock::time_point now = steady_clock::now();
+            if(now >= next_cycle_time) break;
+            struct pollfd pfd = { wake_pipe[0], POLLIN, 0 };
+            int timeout = duration_cast<milliseconds>(next_cycle_time - now + milliseconds(1) - nanoseconds(1)).count();
+            if(poll(&pfd, 1, timeout) > 0) {
+                char buf[64];
+                while(read(wake_pipe[0], buf, sizeof(buf)) > 0);
+                wake_pending = false;
+                break;
+            }
         }
     }
 }
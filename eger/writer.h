@@ -7,44 +7,130 @@
 #include <algorithm>
 #include <iterator>
 #include <chrono>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <thread>
+#include <map>
 #include <eger/types.h>
 #include <eger/logger.h>
+#include <eger/ring.h>
+#include <eger/archiver.h>
+#include <eger/sink.h>
+#include <eger/stats.h>
 
 namespace eger {
 
 class writer {
     public:
-    writer(instance *_inst, size_t queue_size); // for asynchronous writer
+    struct producer_queue {
+        producer_queue(size_t size) : ring(size), abandoned(false) {}
+        spsc_ring<log_stream*> ring;
+        std::atomic<bool> abandoned;
+    };
+
+    // opened file or standard stream shared by all levels writing to it,
+    // records of a batch are collected in buffer and written at once
+    // "binary:", "json:" and "logfmt:" prefixes of a destination name,
+    // the rest is the name of sink
+    enum layout { layout_text, layout_binary, layout_json, layout_logfmt };
+
+    // records of a batch are collected in buffer and given to sink at once,
+    // all levels writing to the same name share a destination
+    struct destination {
+        destination() : format(layout_text), output(0), last_hash(0), last_level(level_critical), repeats(0) {}
+        layout format;
+        sink *output;
+        string buffer;
+        std::vector<size_t> ends; // of records in buffer
+        std::map<const format_descriptor*, uint32_t> ids;
+        destination_stats stats;
+        uint64_t last_hash;     // of the last record written, for dedup_window
+        log_level last_level;
+        std::chrono::system_clock::time_point window_start;
+        uint64_t repeats;       // of it not written yet
+    };
+
+    writer(instance *_inst, size_t queue_size, bool per_thread = false, size_t shard = 0); // for asynchronous writer
     writer(instance *_inst); //for synchronous writer
     ~writer();
 
     static void static_run(writer *wrt);
 
     void push_back(log_stream *ls);
-    void stop();
+    void stop(); // asks writer thread to drain and finish, join it afterwards
+    void wake();
+    writer_stats stats();
 
     static string compose_log_string(log_stream *ls, bool ansi_colors = true);
+    static void compose_log_string(log_stream *ls, bool ansi_colors, string &out);
     static const char *level_to_string(log_level l, bool ansi_colors);
+    // one JSON object or logfmt line per record with UTC timestamp, level,
+    // message and key/value fields
+    static void compose_structured_string(log_stream *ls, layout format, string &out);
 
     private:
-    void perform_writing(log_stream *ls, int &fd);
+    void perform_writing(log_stream *ls);
+    void write_record(log_stream *ls, destination &d);
+    bool repeated(log_stream *ls, destination &d);
+    void write_repeats(destination &d);
+    void perform_binary_writing(log_stream *ls, destination &d);
+    destination *find_destination(const string &name);
+    void flush_destination(destination &d);
+    void flush_destinations();
+    void close_destinations();
     void write_logs();
-    bool try_open_file(const string &fn, int &fd);
-    void check_size_and_rename(const string &fn);
-    void rename_log(const string &from, const string &to);
+    size_t push_to_queue(log_stream *ls, overflow_policy policy);
+    size_t push_to_thread_queue(log_stream *ls, overflow_policy policy);
+    inline bool admitted(log_level lvl, size_t depth);
+    void drop(log_stream *ls);
+    void report_dropped(bool now); // once a second at most unless now
+    void write_thread_logs();
+    bool has_pending();
+    producer_queue *local_queue();
+    void dump_profiles();
+    void dump_stats();
+    void publish_stats();
+    void collect_stats(writer_stats &s);
     void run();
     inline size_t next_nearest_power_of_2(size_t v);
 
     private:
     friend class instance;
     instance *inst;
-    log_stream **queue;
-    size_t queue_mask;
-    size_t writing;
-    size_t accepting;
-    bool wait_for_finish;
-    bool finished;
+    mpmc_ring<log_stream*> *queue;
+    std::atomic<bool> wait_for_finish;
     bool sync_mode;
+    bool per_thread;
+    size_t shard;
+    size_t queue_size;
+    uint64_t generation;
+    size_t high_water_mark;
+    int wake_pipe[2];
+    std::atomic<bool> wake_pending;
+    std::atomic<size_t> dropped[log_level_size];
+    std::chrono::steady_clock::time_point last_drop_report;
+    std::mutex producers_lock;
+    std::vector<producer_queue*> producers;
+    std::vector<log_stream*> batch;
+    struct batch_run { size_t next, end; };     // records of one ring in batch
+    std::vector<batch_run> runs;
+    std::mutex sync_lock;
+    std::map<string, destination> destinations;
+    archiver archives;
+    writer_stats counters;                      // writer's own, copied to published
+    std::mutex stats_lock;
+    writer_stats published;
+};
+
+// destination of a level and the writer shard taking it as published by
+// instance, a record carries the one it was passed with, so records queued
+// before a reconfiguration still go where they were headed
+struct level_route {
+    level_route(writer *_to, const string &_destination) : to(_to), destination(_destination), resolved(0) {}
+    writer *to;
+    string destination;
+    writer::destination *resolved;              // looked up by writer at the first record
 };
 
 }
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <eger/logger.h>
+#include <eger/profiler.h>
+#include <eger/histogram.h>
+
+// benchmarks of the logging paths printed as JSON to stdout, "make bench"
+// writes them to bench.json, configure with CXXFLAGS=-O2 for real numbers
+// usage: benchmark [-t max_threads] [-n records_per_thread] [-o log_file]
+
+namespace {
+
+size_t records = 200000;
+size_t max_threads = 4;
+std::string log_file = "benchmark.log";
+
+uint64_t now_ns() { return eger::tick_clock::to_ns(eger::tick_clock::ticks()); }
+
+void configure(eger::instance &eger_logger) {
+    eger_logger[(size_t) eger::level_info] = log_file;
+    eger_logger[(size_t) eger::level_profile] = log_file;
+    eger_logger.maximum_log_size = (size_t) 1 << 40;
+    eger_logger.ansi_colors = false;
+}
+
+// nanoseconds a call costs, averaged over many
+template <class call>
+double per_call_ns(size_t n, call c) {
+    uint64_t start = now_ns();
+    for(size_t i = 0; i < n; ++i) c(i);
+    return (double) (now_ns() - start) / n;
+}
+
+std::string percentiles(const eger::histogram &h) {
+    std::ostringstream os;
+    os << "{\"p50\": " << h.percentile(0.5) << ", \"p99\": " << h.percentile(0.99) <<
+        ", \"p99.9\": " << h.percentile(0.999) << ", \"max\": " << h.max() << "}";
+    return os.str();
+}
+
+// producer side only, the writer drains in background, the queue holds
+// all records so none goes the overflow path
+std::string producer_latency(bool deferred) {
+    eger::instance eger_logger;
+    configure(eger_logger);
+    eger_logger.queue_size = records;
+    eger_logger.start_writer();
+    eger::histogram h;
+    for(size_t i = 0; i < records; ++i) {
+        uint64_t start = now_ns();
+        if(deferred) log_info_fmt("benchmark record {} of {}", i, records);
+        else log_info("benchmark record " << i << " of " << records);
+        h.add(eger::histogram::bucket(now_ns() - start), 1);
+    }
+    return percentiles(h);
+}
+
+// records per second from the first record till the writer has written the last,
+// producers block instead of dropping
+double throughput(size_t threads, bool sync) {
+    uint64_t start = now_ns();
+    {
+        eger::instance eger_logger;
+        configure(eger_logger);
+        eger_logger.set_overflow_policy(eger::overflow_block);
+        eger_logger.overflow_block_timeout = std::chrono::seconds(10);
+        if(sync) eger_logger.start_sync_writer();
+        else eger_logger.start_writer();
+        std::vector<std::thread> producers;
+        for(size_t t = 0; t < threads; ++t)
+            producers.push_back(std::thread([t] () {
+                for(size_t i = 0; i < records; ++i)
+                    log_info("benchmark record " << i << " of thread " << t);
+            }));
+        for(size_t t = 0; t < producers.size(); ++t) producers[t].join();
+    }
+    return threads * records * 1e9 / (now_ns() - start);
+}
+
+}
+
+int main(int argc, char **argv) {
+    int opt;
+    while((opt = getopt(argc, argv, "t:n:o:")) != -1)
+        switch(opt) {
+            case 't': max_threads = strtoul(optarg, 0, 10); break;
+            case 'n': records = strtoul(optarg, 0, 10); break;
+            case 'o': log_file = optarg; break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-t max_threads] [-n records_per_thread] [-o log_file]\n";
+                return 1;
+        }
+    if(!max_threads) max_threads = 1;
+    if(!records) records = 1;
+
+    std::cerr << "disabled level\n";
+    double rand_ns, disabled_ns;
+    size_t sum = 0;
+    {
+        eger::instance eger_logger;
+        configure(eger_logger);
+        eger_logger.start_writer();
+        rand_ns = per_call_ns(records * 10, [&sum] (size_t) { sum += rand(); });
+        disabled_ns = per_call_ns(records * 10, [&sum] (size_t i) { log_debug("disabled " << i << sum); });
+    }
+
+    std::cerr << "producer latency\n";
+    std::string streamed = producer_latency(false);
+    std::string deferred = producer_latency(true);
+
+    std::cerr << "throughput\n";
+    std::vector<size_t> counts;
+    for(size_t t = 1; t < max_threads; t *= 2) counts.push_back(t);
+    counts.push_back(max_threads);
+    std::ostringstream threads;
+    for(size_t i = 0; i < counts.size(); ++i)
+        threads << (i ? ",\n        " : "") << "{\"threads\": " << counts[i] <<
+            ", \"records_per_second\": " << (uint64_t) throughput(counts[i], false) << "}";
+    double async_rate = throughput(1, false);
+    double sync_rate = throughput(1, true);
+
+    std::cerr << "profiler\n";
+    double profiler_ns;
+    {
+        eger::instance eger_logger;
+        configure(eger_logger);
+        eger_logger.start_writer();
+        profiler_ns = per_call_ns(records * 10, [] (size_t) {
+            profiler_start(benchmark_section);
+            profiler_stop(benchmark_section);
+        });
+    }
+    unlink(log_file.c_str());
+
+#ifdef __OPTIMIZE__
+    const char *optimized = "true";
+#else
+    const char *optimized = "false";
+#endif
+    std::cout << "{\n" <<
+        "    \"optimized\": " << optimized << ",\n" <<
+        "    \"records_per_thread\": " << records << ",\n" <<
+        "    \"rand_ns\": " << rand_ns << ",\n" <<
+        "    \"disabled_level_ns\": " << disabled_ns << ",\n" <<
+        "    \"producer_latency_ns\": " << streamed << ",\n" <<
+        "    \"deferred_producer_latency_ns\": " << deferred << ",\n" <<
+        "    \"throughput\": [\n        " << threads.str() << "\n    ],\n" <<
+        "    \"async_records_per_second\": " << (uint64_t) async_rate << ",\n" <<
+        "    \"sync_records_per_second\": " << (uint64_t) sync_rate << ",\n" <<
+        "    \"profiler_start_stop_ns\": " << profiler_ns << "\n" <<
+        "}\n";
+    return sum == 42 ? 1 : 0;
+}
@@ -0,0 +1,33 @@
+#include <iostream>
+#include <eger/logger.h>
+#include <eger/sink.h>
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_error] = "memory:errors";
+    eger_logger[(size_t) eger::level_warning] = "memory:errors";
+    eger_logger.ansi_colors = false;
+    eger_logger.dedup_window = std::chrono::milliseconds(100);
+
+    eger_logger.start_sync_writer();
+
+    // a dependency is down
+    for(size_t i = 0; i < 1000; ++i) log_error("connection to 10.0.0." << 1 << " refused");
+    log_warning_fmt("giving up after {} attempts", 1000);
+    std::vector<std::string> r = eger::memory_sink_records("errors");
+    if(r.size() != 3 || r[1].find("last message repeated 999 times") == std::string::npos)
+        log_critical("consecutive repeats aren't collapsed, " << r.size() << " records");
+
+    // the same error for half a second, a record and its count per window
+    eger::memory_sink_clear("errors");
+    std::chrono::steady_clock::time_point until = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while(std::chrono::steady_clock::now() < until) {
+        log_error_fmt("connection to {} refused", "10.0.0.1");
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    r = eger::memory_sink_records("errors");
+    if(r.size() < 6 || r.size() > 12)
+        log_critical("windowed repeats aren't collapsed, " << r.size() << " records");
+    for(size_t i = 0; i < r.size(); ++i) std::cout << r[i];
+}
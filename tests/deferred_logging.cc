@@ -0,0 +1,27 @@
+#include <iostream>
+#include <eger/logger.h>
+
+struct point {
+    int x, y;
+};
+
+std::ostream &operator<<(std::ostream &s, const point &p) {
+    return s << '(' << p.x << ", " << p.y << ')';
+}
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_info] = "binary:deferred_logging.bin";
+    eger_logger[(size_t) eger::level_warning] = "stderr";
+
+    eger_logger.start_writer();
+
+    std::string name("worker");
+    point p = { 3, 4 };
+    for(size_t i = 0; i < 1000; ++i)
+        log_info_fmt("request {} done by {} in {}ms", i, name, 0.25 * i);
+    log_info_fmt("static {} and computed {}", eger::literal("literal"), p);
+    log_warning_fmt("{} of {} with {} extra", 1, 2, 3, "arguments");
+    log_critical_fmt("decode with eger_decode deferred_logging.bin");
+}
@@ -0,0 +1,43 @@
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <eger/logger.h>
+
+void work(size_t thread) {
+    for(size_t i = 0; i < 100000; ++i)
+        if(i % 10) log_debug_fmt("thread {} step {}", thread, i);
+        else log_debug("thread " << thread << " checkpoint " << i);
+}
+
+int main() {
+    // a child crashing with records in its rings leaves flight_recorder_crash.bin.<time>-0
+    pid_t child = fork();
+    if(child == 0) {
+        eger::instance eger_logger;
+        eger_logger[(size_t) eger::level_critical] = "stderr";
+        eger_logger.set_flight_recorder(eger::level_debug);
+        eger_logger.flight_recorder_file = "flight_recorder_crash.bin";
+        eger_logger.flight_recorder_signals = true;
+        eger_logger.start_writer();
+        work(0);
+        raise(SIGSEGV);
+    }
+    int status;
+    waitpid(child, &status, 0);
+
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_info] = "stderr";
+    eger_logger.set_flight_recorder(eger::level_debug);
+    eger_logger.flight_recorder_size = 64*1024;
+
+    eger_logger.start_writer();
+
+    std::vector<std::thread> threads;
+    for(size_t i = 1; i <= 4; ++i) threads.push_back(std::thread(work, i));
+    for(size_t i = 0; i < threads.size(); ++i) threads[i].join();
+
+    log_info("child " << (WIFSIGNALED(status) && WTERMSIG(status) == SIGSEGV ? "crashed" : "didn't crash") <<
+            ", decode flight_recorder_crash.bin.* with eger_decode");
+    log_critical("debug records before this are in flight_recorder.bin.*");
+}
@@ -0,0 +1,21 @@
+#include <iostream>
+#include <eger/logger.h>
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_info] = "log_rotation.log";
+    eger_logger.maximum_log_size = 256*1024;
+    eger_logger.maximum_log_archives = 4;
+    eger_logger.compress_archives = true;
+    eger_logger.flush_interval = std::chrono::milliseconds(10);
+
+    eger_logger.start_writer();
+
+    for(size_t i = 0; i < 100000; ++i) {
+        log_info("record " << i << " of a log rotated every 256k, four gzipped archives kept");
+        if(i % 10000 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    log_critical("done, see log_rotation.log.*");
+}
@@ -11,7 +11,7 @@ int main() {
 
     eger_logger.start_sync_writer();
 
-    for(size_t i = 0; i < 10*1000*1000; usleep(1)) {
+    for(size_t i = 0; i < 10*1000*1000; ++i, usleep(1)) {
         log_warning("this is a warning");
         log_error("this is a error");
         log_critical("this is critical");
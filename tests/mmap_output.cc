@@ -0,0 +1,23 @@
+#include <iostream>
+#include <eger/logger.h>
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_debug] = "mmap:mmap_output.log";
+    eger_logger[(size_t) eger::level_info] = "mmap:json:mmap_output.json";
+    eger_logger.maximum_log_size = 1024*1024;
+    eger_logger.mmap_chunk_size = 64*1024;
+    eger_logger.mmap_sync_interval = std::chrono::milliseconds(50);
+    eger_logger.flush_interval = std::chrono::milliseconds(10);
+
+    eger_logger.start_writer();
+
+    for(size_t i = 0; i < 50000; ++i) {
+        log_debug("record " << i << " copied into a mapping extended by 64k");
+        if(i % 1000 == 0) log_info_kv("progress", eger::kv("records", i));
+        if(i % 10000 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    }
+
+    log_critical("done, files are cut to their contents, see mmap_output.*");
+}
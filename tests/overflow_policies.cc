@@ -0,0 +1,60 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <fstream>
+#include <cstdio>
+#include <eger/logger.h>
+
+void burst(size_t id) {
+    for(size_t i = 0; i < 20000; ++i) {
+        log_debug("thread " << id << " debug " << i);
+        log_info("thread " << id << " info " << i);
+        if(id == 0 && i == 10000) log_error("thread " << id << " error in the middle of the burst");
+    }
+}
+
+void run(eger::overflow_policy policy, bool per_thread) {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_error] = "overflow_policies_errors.log";
+    eger_logger[(size_t) eger::level_info] = "overflow_policies.log";
+    eger_logger[(size_t) eger::level_debug] = "overflow_policies.log";
+    eger_logger.queue_size = 1024;
+    eger_logger.high_water_mark = 1024;
+    eger_logger.per_thread_queues = per_thread;
+    eger_logger.set_overflow_policy(policy);
+    eger_logger.start_writer();
+
+    log_critical("policy " << (int) policy << (per_thread ? " with per thread queues" : ""));
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < 4; ++i)
+        threads.push_back(std::thread(burst, i));
+    for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+}
+
+// the queue is drained when instance is gone
+bool error_written(eger::overflow_policy policy, bool per_thread) {
+    std::remove("overflow_policies_errors.log");
+    run(policy, per_thread);
+    std::ifstream f("overflow_policies_errors.log");
+    std::string line;
+    return (bool) std::getline(f, line);
+}
+
+int main() {
+    bool kept[2];
+    for(int per_thread = 0; per_thread < 2; ++per_thread) {
+        run(eger::overflow_drop_newest, per_thread);
+        run(eger::overflow_block, per_thread);
+        kept[per_thread] = error_written(eger::overflow_overwrite_oldest, per_thread);
+        run(eger::overflow_drop_lower_severity, per_thread);
+    }
+
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger.start_sync_writer();
+    // debug and info records flooding the queue never push an error out
+    if(!kept[0] || !kept[1])
+        log_critical("error overwritten by less severe records in " << (kept[0] ? "per thread queues" : "shared queue"));
+}
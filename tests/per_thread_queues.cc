@@ -0,0 +1,42 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <eger/logger.h>
+#include <eger/sink.h>
+
+void worker(size_t id) {
+    for(size_t i = 0; i < 10000; ++i)
+        log_info("thread " << id << " record " << i);
+}
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_info] = "per_thread_queues.log";
+    eger_logger.per_thread_queues = true;
+
+    eger_logger.start_writer();
+
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < 8; ++i)
+        threads.push_back(std::thread(worker, i));
+    for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    // a clock stepping back within a thread doesn't reorder its records
+    eger_logger.set_destination(eger::level_warning, "memory:stepping");
+    std::chrono::system_clock::time_point t = eger::fast_clock::now();
+    for(size_t i = 0; i < 3; ++i) {
+        eger::log_stream *ls = eger::log_stream_pool::acquire(eger::level_warning);
+        *ls << "step " << i;
+        ls->moment = t - std::chrono::microseconds(i);
+        eger_logger.pass_to_writer(ls);
+    }
+    while(eger::memory_sink_records("stepping").size() < 3) std::this_thread::yield();
+    std::vector<std::string> steps = eger::memory_sink_records("stepping");
+    for(size_t i = 0; i < steps.size(); ++i)
+        if(steps[i].find("step " + std::to_string(i)) == std::string::npos)
+            log_critical("records of a thread reordered: " << steps[i]);
+
+    log_critical("all threads finished");
+}
@@ -0,0 +1,41 @@
+#include <iostream>
+#include <thread>
+#include <eger/profiler.h>
+
+size_t leaf(size_t x) {
+    profiler_scope(leaf);
+    for(size_t i = 0; i < 100; ++i) x = x * 31 + i;
+    return x;
+}
+
+size_t middle(size_t x) {
+    profiler_scope(middle);
+    for(size_t i = 0; i < 10; ++i) x += leaf(x);
+    return x;
+}
+
+void worker(size_t *res) {
+    profiler_scope(worker);
+    for(size_t i = 0; i < 10000; ++i) {
+        *res += middle(i);
+        *res += leaf(i);
+    }
+}
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_profile] = "stderr";
+    eger_logger.start_writer();
+
+    size_t res[2] = { 0, 0 };
+    std::thread t(worker, res);
+    worker(res + 1);
+    t.join();
+    std::cout << (res[0] == res[1]) << std::endl;
+
+    profiler_dump_tree();
+    profiler_dump_all();
+    std::cout << eger::profiler_folded_stacks();
+
+    return 0;
+}
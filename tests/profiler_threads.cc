@@ -0,0 +1,38 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <eger/profiler.h>
+
+void worker(size_t iterations) {
+    size_t x = 0;
+    for(size_t i = 0; i < iterations; ++i) {
+        profiler_start(shared_section);
+        for(size_t j = 0; j < 100; ++j) x = x * 31 + j;
+        profiler_stop(shared_section);
+        profiler_start(short_section);
+        x ^= i;
+        profiler_stop(short_section);
+    }
+    std::cout << x % 2;
+}
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_profile] = "stderr";
+    eger_logger.profiler_dump_interval = std::chrono::seconds(60);
+    eger_logger.start_writer();
+
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < 4; ++i)
+        threads.push_back(std::thread(worker, 100000));
+    for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+    std::cout << std::endl;
+
+    profiler_dump(shared_section);      // 400000 calls from 4 exited threads
+    worker(1000);
+    std::cout << std::endl;
+    profiler_dump_all();                // 1000 calls of both labels from main thread
+
+    return 0;
+}
@@ -0,0 +1,30 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <eger/logger.h>
+
+void worker(size_t id) {
+    for(size_t i = 0; i < 1000000; ++i) {
+        log_every_n(warning, 100000, "thread " << id << " every 100000th, now " << i);
+        log_first_n(info, 2, "thread " << id << " first two, now " << i);
+        log_every_ms(warning, 10, "thread " << id << " once in 10ms, now " << i);
+        log_rate_limited(error, 100, 5, "thread " << id << " 100 per second, bursts of 5, now " << i);
+    }
+}
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_error] = "rate_limiting.log";
+    eger_logger[(size_t) eger::level_info] = "rate_limiting.log";
+    eger_logger[(size_t) eger::level_warning] = "rate_limiting.log";
+    eger_logger.start_writer();
+
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < 4; ++i)
+        threads.push_back(std::thread(worker, i));
+    for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    log_critical("16 million calls, a few hundred records");
+}
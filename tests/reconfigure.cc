@@ -0,0 +1,41 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <eger/logger.h>
+
+std::atomic<bool> done(false);
+
+void worker(size_t id) {
+    for(size_t i = 0; !done; ++i) {
+        log_debug("thread " << id << " record " << i);
+        if(i % 1000 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger.start_writer();
+
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < 4; ++i)
+        threads.push_back(std::thread(worker, i));
+
+    // as an admin command or SIGHUP handler thread would do
+    for(size_t i = 0; i < 10; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        eger_logger.set_destination(eger::level_debug, i % 2 ? "" : "reconfigure.log");
+    }
+    eger::log_map destinations(eger::log_level_size);
+    destinations[(size_t) eger::level_critical] = "stderr";
+    destinations[(size_t) eger::level_debug] = "reconfigure_last.log";
+    eger_logger.reconfigure(destinations);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    done = true;
+    for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    log_critical("debug was switched on and off five times");
+}
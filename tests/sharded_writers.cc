@@ -0,0 +1,61 @@
+#include <iostream>
+#include <eger/logger.h>
+#include <eger/sink.h>
+
+// destination taking 20ms for every batch, like a disk busy with fsync
+class slow_sink : public eger::sink {
+    public:
+    bool open(bool &started) { started = false; return true; }
+    void write(const eger::sink_batch &) { std::this_thread::sleep_for(std::chrono::milliseconds(20)); }
+};
+
+eger::sink *create_slow(const std::string &, const eger::sink_context &) { return new slow_sink; }
+
+int main() {
+    eger::register_sink_scheme("slow", create_slow);
+
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "memory:critical";
+    eger_logger[(size_t) eger::level_error] = "stderr";
+    eger_logger[(size_t) eger::level_info] = "sharded_writers.log";
+    eger_logger[(size_t) eger::level_warning] = "sharded_writers.log";
+    eger_logger[(size_t) eger::level_debug] = "slow:";
+    eger_logger.writer_shards = 3;
+    eger_logger.destination_shards["slow:"] = 1;
+    eger_logger.destination_shards["memory:critical"] = 2;
+    eger_logger.destination_shards["memory:before"] = 1;
+    eger_logger.destination_shards["memory:after"] = 0;
+    eger_logger.shard_cpus.push_back(0);
+    eger_logger.flush_interval = std::chrono::milliseconds(1);
+
+    eger_logger.start_writer();
+
+    std::thread debugging([] () {
+        for(size_t i = 0; i < 100000; ++i) log_debug("heavy debug record " << i);
+    });
+    for(size_t i = 0; i < 10000; ++i) {
+        if(i % 2) log_info("record " << i << " of a file shared by info and warning");
+        else log_warning("record " << i << " of a file shared by info and warning");
+    }
+
+    // critical records are on their own shard, the slow one doesn't hold them up
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < 10; ++i) log_critical("critical " << i);
+    while(eger::memory_sink_records("critical").size() < 10) std::this_thread::yield();
+    log_error("10 critical records written in " << std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count() << "us next to a slow shard");
+    debugging.join();
+
+    // profile moves to another shard while its records wait behind the slow destination
+    eger_logger.set_destination(eger::level_profile, "memory:before");
+    log_debug("keeps the slow shard busy");
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    for(size_t i = 0; i < 500; ++i) log_profile("record " << i << " before moving");
+    eger_logger.set_destination(eger::level_profile, "memory:after");
+    for(size_t i = 0; i < 500; ++i) log_profile("record " << i << " after moving");
+    while(eger::memory_sink_records("after").size() < 500) std::this_thread::yield();
+    for(size_t i = 0; i < 100 && eger::memory_sink_records("before").size() < 500; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if(eger::memory_sink_records("before").size() != 500)
+        log_error(eger::memory_sink_records("before").size() << " of 500 records queued before moving were written");
+}
@@ -0,0 +1,61 @@
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <iostream>
+#include <eger/logger.h>
+#include <eger/sink.h>
+
+// records of "upper:" destinations are written to stdout in capitals
+class upper_sink : public eger::sink {
+    public:
+    bool open(bool &started) { started = false; return true; }
+    void write(const eger::sink_batch &batch) {
+        std::string s(batch.data);
+        for(size_t i = 0; i < s.size(); ++i) s[i] = toupper(s[i]);
+        std::cout << s << std::flush;
+    }
+};
+
+eger::sink *create_upper(const std::string &, const eger::sink_context &) { return new upper_sink; }
+
+int main() {
+    const char *collector_path = "sinks.sock";
+    unlink(collector_path);
+    int collector = socket(AF_UNIX, SOCK_DGRAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, collector_path);
+    if(bind(collector, (sockaddr*) &addr, sizeof(addr)) < 0) return 1;
+
+    eger::register_sink_scheme("upper", create_upper);
+
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_error] = "upper:";
+    eger_logger[(size_t) eger::level_info] = "memory:recent";
+    eger_logger[(size_t) eger::level_warning] = "json:unixgram:sinks.sock";
+    eger_logger[(size_t) eger::level_debug] = "unix:sinks_nobody_listens.sock";
+    eger_logger.memory_sink_size = 10;
+    eger_logger.ansi_colors = false;
+    eger_logger.flush_interval = std::chrono::milliseconds(10);
+
+    eger_logger.start_writer();
+
+    for(size_t i = 0; i < 100; ++i) log_info("record " << i);
+    for(size_t i = 0; i < 3; ++i) log_warning_kv("to collector", eger::kv("n", i));
+    log_error("custom sink");
+    // lost and reported as a count, not written to stderr
+    for(size_t i = 0; i < 5; ++i) log_debug("nobody gets record " << i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    std::vector<std::string> recent = eger::memory_sink_records("recent");
+    log_critical(recent.size() << " records kept in memory, last is " << recent.back().substr(13, 22));
+
+    char buf[1024];
+    ssize_t n;
+    while((n = recv(collector, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+        log_critical("collector got " << std::string(buf, n - 1));
+    close(collector);
+    unlink(collector_path);
+}
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <vector>
+#include <thread>
+#include <eger/tracer.h>
+
+void worker(size_t id) {
+    for(size_t i = 0; i < 1000; ++i) {
+        span_begin(request);
+        if(i % 100 == 0) span_instant(checkpoint);
+        span_begin(parse);
+        for(size_t j = 0; j < 1000 * (id + 1); ++j) i ^= 0;
+        span_end(parse);
+        span_end(request);
+    }
+}
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger.tracing = true;
+    eger_logger.trace_ring_size = 1024;     // about 250 last requests per thread
+    eger_logger.trace_file = "span_tracing.json";
+    eger_logger.start_writer();
+
+    std::vector<std::thread> threads;
+    for(size_t i = 0; i < 4; ++i)
+        threads.push_back(std::thread(worker, i));
+    for(size_t i = 0; i < threads.size(); ++i)
+        threads[i].join();
+
+    log_critical("open span_tracing.json in chrome://tracing or ui.perfetto.dev");
+}
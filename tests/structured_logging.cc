@@ -0,0 +1,24 @@
+#include <math.h>
+#include <eger/logger.h>
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_critical] = "stderr";
+    eger_logger[(size_t) eger::level_info] = "json:structured_logging.json";
+    eger_logger[(size_t) eger::level_warning] = "logfmt:structured_logging.log";
+    eger_logger[(size_t) eger::level_debug] = "binary:structured_logging.bin";
+
+    eger_logger.start_writer();
+
+    std::string path("/index.html");
+    for(size_t i = 0; i < 100; ++i)
+        log_info_kv("request done", eger::kv("latency_us", 125 + i), eger::kv("status", 200),
+                eger::kv("path", path), eger::kv("cached", i % 2 == 0));
+    log_info_kv("needs \"escaping\"\n", eger::kv("quote", "a \"b\" \\ c\td"), eger::kv("ratio", NAN),
+            eger::kv("control", "\x01"));
+    log_warning_kv("slow {} request", "GET", eger::kv("latency_ms", 1.5), eger::kv("empty", ""),
+            eger::kv("eq", "a=b"));
+    log_debug_kv("decode with eger_decode -j structured_logging.bin", eger::kv("signed", -5),
+            eger::kv("literal", eger::literal("kept")));
+    log_critical_kv("text destinations get fields appended", eger::kv("key", "value"), eger::kv("n", 1));
+}
@@ -0,0 +1,28 @@
+#include <iostream>
+#include <eger/logger.h>
+#include <eger/sink.h>
+
+int main() {
+    eger::instance eger_logger;
+    eger_logger[(size_t) eger::level_error] = "stderr";
+    eger_logger[(size_t) eger::level_info] = "memory:stats";
+    eger_logger[(size_t) eger::level_profile] = "stdout";
+    eger_logger.queue_size = 1024;
+    eger_logger.flush_interval = std::chrono::milliseconds(10);
+    eger_logger.stats_interval = std::chrono::seconds(1);
+
+    eger_logger.start_writer();
+
+    // a burst larger than the queue, some of it is dropped
+    eger::producer_stats before = eger_logger.stats().producers;
+    for(size_t i = 0; i < 100000; ++i) log_info("record " << i);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+
+    eger::logger_stats s = eger_logger.stats();
+    uint64_t pushed = s.producers.pushed - before.pushed, dropped = s.producers.dropped - before.dropped;
+    const eger::destination_stats &d = s.writers[0].destinations[0];
+    if(pushed < 100000 || d.name != "memory:stats" || d.records + dropped != 100000 ||
+            s.producers.deepest_queue > s.writers[0].queue_capacity)
+        log_error("counters don't add up: " << eger::stats_summary(s));
+    log_profile(eger::stats_summary(s));
+}